@@ -7,6 +7,9 @@ struct HardwareStatus {
     bool valve_ok[MAX_VALVES];
     bool flow_ok[MAX_FLOW_SENSORS];
     bool temp_ok;
+    int temp_probe_count;
+    uint8_t temp_probe_addr[MAX_TEMP_PROBES][8];
+    bool temp_probe_ok[MAX_TEMP_PROBES];
 };
 
 #endif
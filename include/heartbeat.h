@@ -0,0 +1,28 @@
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include <stdint.h>
+
+#define HEARTBEAT_VERSION 1
+
+// Binary heartbeat published on <base>/<uid>/<device>/heartbeat.
+// Little-endian, packed, 32 bytes; bump HEARTBEAT_VERSION when the layout changes.
+struct __attribute__((packed)) HeartbeatPayload {
+    uint8_t version;
+    uint8_t resetReason;        // esp_reset_reason_t
+    int8_t rssi;                // dBm
+    uint8_t valveMask;          // open valves
+    uint32_t uptimeS;
+    uint32_t minFreeHeap;       // low-water mark since boot (bytes)
+    uint32_t largestFreeBlock;  // bytes
+    uint32_t maxLoopUs;         // slowest control-loop iteration since the last heartbeat
+    uint8_t telemetryQueue;     // summaries waiting for the uplink task
+    uint8_t alarmQueue;         // leak events waiting for MQTT
+    uint16_t storeDepth;        // summaries held in flash
+    uint16_t mqttReconnects;    // successful connects since boot
+    uint16_t wifiReconnects;    // successful associations since boot
+    uint16_t wifiFailures;
+    uint16_t publishDrops;      // MQTT publish queue overflows
+};
+
+#endif
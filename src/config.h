@@ -6,6 +6,8 @@
 #define RGB_LED_PIN 8
 #endif
 #define NUMPIXELS 1
+#define LED_TICK_INTERVAL 20        // ms between animation frames
+#define LED_QUEUE_LENGTH 4          // patterns waiting to play
 #define RESET_BUTTON_PIN 9
 
 #define MAX_VALVES 4
@@ -17,6 +19,64 @@
 
 #define ONE_WIRE_BUS TEMP_SENSOR_PIN
 
+// Flow Sensor Configuration
+#define FLOW_K_FACTOR 7.5f          // Pulse frequency (Hz) per L/min
+#define FLOW_SAMPLE_INTERVAL 250    // ms between internal flow samples
+#define FLOW_PULSE_HISTORY 8        // pulse timestamps kept per channel (power of 2)
+#define FLOW_PERIOD_MODE_HZ 10      // below this pulse rate (~1.3 L/min), use pulse intervals
+#define FLOW_PULSE_MAX_AGE 10000    // ms; older pulses are ignored by the period estimator
+#define FLOW_CAL_MAX_POINTS 8       // points per calibration curve
+
+// Volume totalizer checkpoints (NVS writes are rate limited to spare flash)
+#define TOTALIZER_MIN_INTERVAL 60000      // ms; never write more often than this
+#define TOTALIZER_MAX_INTERVAL 600000     // ms; write at least this often while flowing
+#define TOTALIZER_CHECKPOINT_VOLUME 10.0  // L; unsaved volume that forces an early write
+
+// Leak Detection (flow on a channel whose valve is closed)
+#define LEAK_FLOW_THRESHOLD 0.2f    // L/min treated as real flow
+#define LEAK_CONFIRM_SAMPLES 8      // consecutive samples before alarming
+#define LEAK_AUTO_SHUTOFF false     // close every valve when a leak is confirmed
+
+// Temperature Sensor Configuration
+#define MAX_TEMP_PROBES 4           // DS18B20 probes cached from the 1-Wire bus
+#define TEMP_RESOLUTION 11          // DS18B20 resolution in bits (9-12); 11 = 0.125 °C in 375 ms
+#define TEMP_CONVERSION_TIME 0      // ms; 0 = derive from resolution
+#define TEMP_READ_INTERVAL 0        // ms between conversion starts; 0 = back to back, several per period
+
+// Telemetry Configuration
+#define HEARTBEAT_INTERVAL 300000   // ms; liveness comes from the MQTT keepalive and last will
+#define TELEMETRY_INTERVAL 2000     // ms between uploaded summaries
+
+// Report-by-exception: a summary is uploaded only when a value leaves its
+// deadband max(abs, rel * |last reported|), or after REPORT_MAX_SILENCE
+#define FLOW_DEADBAND_ABS 0.1f      // L/min
+#define FLOW_DEADBAND_REL 0.05f     // fraction of last reported value
+#define TEMP_DEADBAND_ABS 0.25f     // °C
+#define TEMP_DEADBAND_REL 0.0f
+#define REPORT_MAX_SILENCE 60000    // ms; keepalive upload even if nothing changed
+
+// Task Configuration (FreeRTOS priorities, higher preempts lower)
+#define SENSING_TASK_PRIORITY 5     // flow/temperature sampling, leak detection
+#define CONTROL_TASK_PRIORITY 4     // MQTT, valve actuation, alarms, heartbeat
+#define WEB_TASK_PRIORITY 3         // Arduino loop task: web/DNS and WiFi supervision
+#define UPLINK_TASK_PRIORITY 2      // telemetry batching and store replay
+#define REQUEST_TASK_PRIORITY 2     // outbound HTTP requests (RequestQueue)
+#define UI_TASK_PRIORITY 1          // reset button
+
+#define SENSING_TASK_STACK 4096     // bytes
+#define CONTROL_TASK_STACK 8192     // TLS handshake runs here
+#define UPLINK_TASK_STACK 6144
+#define REQUEST_TASK_STACK 6144
+#define UI_TASK_STACK 3072
+
+#define CONTROL_TASK_PERIOD 10      // ms
+#define WEB_TASK_PERIOD 10          // ms
+#define UI_TASK_PERIOD 20           // ms
+
+#define TELEMETRY_QUEUE_LENGTH 4    // summaries waiting for the uplink
+#define ALARM_QUEUE_LENGTH 8        // leak events waiting for MQTT
+#define REQUEST_QUEUE_LENGTH 6      // outbound HTTP requests waiting or in flight
+
 // Network Configuration
 #define AP_SSID "Green Mesh"
 #define AP_PASSWORD "Admin@123456"
@@ -24,7 +84,28 @@
 
 // API Configuration
 #define API_ENDPOINT "http://127.0.0.1:8000//api/device/onboard"
-#define CONNECTIVITY_CHECK_URL "http://httpbin.org/get"
+// Connectivity probe: DNS, then TCP connect, then (if a path is set) HEAD
+// against the host and port of BACKEND_BASE_URL; the result is cached and
+// refreshed in the background
+#define CONNECTIVITY_PROBE_PATH "/"     // "" stops after the TCP connect
+#define CONNECTIVITY_PROBE_TIMEOUT 2000 // ms per layer
+#define CONNECTIVITY_PROBE_TTL 60000    // ms a result stays valid
+#define CONNECTIVITY_PROBE_STACK 3072
+#define CONNECTIVITY_PROBE_PRIORITY 1
+#define BACKEND_BASE_URL "http://192.168.31.156:8000"
+#define SENSOR_DATA_PATH "/api/device/data"
+#define HEALTH_REPORT_PATH "/api/device/health-report"
+#define UPLINK_TIMEOUT 5000         // ms per telemetry request
+#define UPLINK_BATCH_SIZE 5         // summaries per request (1 = legacy single-object payload)
+#define UPLINK_BATCH_WINDOW 10000   // ms; a partial batch is flushed after this long
+#define UPLINK_CONTENT_TYPE "application/json" // or "application/cbor"; a 415 reply falls back to JSON
+#define UPLINK_PAYLOAD_BUFFER 4096  // bytes; fits max(UPLINK_BATCH_SIZE, STORE_DRAIN_BATCH) summaries
+
+// Store-and-forward telemetry queue (append-only segment files on LittleFS)
+#define STORE_CAPACITY 1024         // records kept while offline; oldest segment dropped beyond this
+#define STORE_SEGMENT_RECORDS 64    // records per segment file (~25 KB)
+#define STORE_DRAIN_BATCH 5         // records replayed per drain step
+#define STORE_DRAIN_INTERVAL 1000   // ms between drain steps
 #define DEVICE_STATUS_BASE_URL "http://127.0.0.1:8000//api/uid/device-status?device_number="
 
 // MQTT Configuration
@@ -33,11 +114,39 @@
 #define MQTT_USER "navdeep"
 #define MQTT_PASSWORD "Raushan@434"
 #define MQTT_BASE_TOPIC "/greenmesh"
+#define MQTT_BACKOFF_INITIAL 1000   // ms before the first retry, doubled per failure
+#define MQTT_BACKOFF_MAX 60000      // ms cap on the retry delay
+#define MQTT_SOCKET_TIMEOUT 5       // s; bounds a single connect attempt
+#define MQTT_KEEPALIVE 60           // s; broker publishes the last will after 1.5x this
+#define MQTT_TLS_SESSION_NVS true   // keep the TLS session across reboots (written after full handshakes)
+#define MQTT_TLS_SESSION_MAX 3072   // bytes; serialized session incl. the server certificate
+#define MQTT_TLS_SESSION_SAVE_INTERVAL 1800000 // ms; at most one session write to NVS per 30 min
+
+// Telemetry and health go out on <base>/<uid>/<device>/telemetry and /health
+// over the MQTT session; false keeps the HTTP uploads to BACKEND_BASE_URL.
+// PubSubClient publishes at QoS 0 only, so delivery is backed by the
+// telemetry store: the uplink task waits for the control task to write each
+// batch to the broker socket, and a batch that was not written stays stored.
+// Telemetry payloads use UPLINK_CONTENT_TYPE (CBOR maps start with 0xBF, JSON with '{').
+#define TELEMETRY_OVER_MQTT true
+#define MQTT_PUBLISH_QUEUE_BYTES 12288  // ring buffer; largest item is about half of this
+#define MQTT_PUBLISH_BURST 4        // queued messages written per loop() call
+#define MQTT_PUBLISH_WAIT 5000      // ms the uplink waits for its batch to be published
 
 
 // Network Timeouts
-#define HTTP_TIMEOUT 10000
-#define WIFI_RETRY_COUNT 20
+#define HTTP_TIMEOUT 10000          // ms per attempt outside the backend session
+#define REQUEST_BACKOFF_INITIAL 1000  // ms before the first retry, doubled per failure
+#define REQUEST_BACKOFF_MAX 30000   // ms cap on the retry delay
+#define VALIDATION_DEADLINE 60000   // ms to get a validation answer, retries included
+#define HEALTH_REPORT_DEADLINE 300000 // ms; health reports are retried for this long
+#define WIFI_CONNECT_TIMEOUT 10000  // ms per connection attempt
+#define WIFI_BOOT_ATTEMPTS 3        // failed attempts at boot before falling back to AP mode
+#define WIFI_BACKOFF_INITIAL 1000   // ms before the first retry, doubled per failure
+#define WIFI_BACKOFF_MAX 60000      // ms cap on the retry delay
+#define WIFI_FAST_CONNECT true      // try the cached BSSID/channel before a full scan
+#define WIFI_STATIC_IP false        // reuse the cached lease as a static IP and skip DHCP
+                                    // (only for networks where that address is reserved)
 
 // AP Mode IP Configuration
 #define AP_IP_ADDR IPAddress(192, 168, 4, 1)
@@ -0,0 +1,36 @@
+#include "flow_calibration.h"
+
+void FlowCalibration::reset() {
+    count = 0;
+    memset(hz, 0, sizeof(hz));
+    memset(lpm, 0, sizeof(lpm));
+}
+
+bool FlowCalibration::isValid() const {
+    if (count > FLOW_CAL_MAX_POINTS) return false;
+    if (count > 0 && hz[0] <= 0) return false;
+
+    for (int i = 0; i < count; i++) {
+        if (lpm[i] < 0) return false;
+        if (i > 0 && hz[i] <= hz[i - 1]) return false;
+    }
+    return true;
+}
+
+float FlowCalibration::toLitersPerMinute(float pulseHz) const {
+    if (count == 0) return pulseHz / FLOW_K_FACTOR;
+    if (pulseHz <= 0) return 0;
+
+    // Below the first point, interpolate from the origin
+    if (count == 1 || pulseHz <= hz[0]) {
+        return pulseHz * lpm[0] / hz[0];
+    }
+
+    int i = 1;
+    while (i < count - 1 && pulseHz > hz[i]) i++;
+
+    // Interpolates inside the curve, extends the last segment beyond it
+    float slope = (lpm[i] - lpm[i - 1]) / (hz[i] - hz[i - 1]);
+    float value = lpm[i - 1] + (pulseHz - hz[i - 1]) * slope;
+    return value > 0 ? value : 0;
+}
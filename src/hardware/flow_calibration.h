@@ -0,0 +1,19 @@
+#ifndef FLOW_CALIBRATION_H
+#define FLOW_CALIBRATION_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Piecewise-linear curve from pulse frequency (Hz) to flow (L/min).
+// Points are sorted by frequency. An empty curve falls back to FLOW_K_FACTOR.
+struct FlowCalibration {
+    uint8_t count;
+    float hz[FLOW_CAL_MAX_POINTS];
+    float lpm[FLOW_CAL_MAX_POINTS];
+
+    void reset();
+    bool isValid() const;
+    float toLitersPerMinute(float pulseHz) const;
+};
+
+#endif
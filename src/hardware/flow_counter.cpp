@@ -0,0 +1,44 @@
+#include "flow_counter.h"
+#include <esp_timer.h>
+
+static const int flowPins[MAX_FLOW_SENSORS] = FLOW_SENSOR_PINS;
+
+// Channel i is written only by its ISR (see pulse_channel.h)
+static PulseChannel channels[MAX_FLOW_SENSORS];
+
+static void IRAM_ATTR onFlow0() { channels[0].record((uint32_t)esp_timer_get_time()); }
+static void IRAM_ATTR onFlow1() { channels[1].record((uint32_t)esp_timer_get_time()); }
+static void IRAM_ATTR onFlow2() { channels[2].record((uint32_t)esp_timer_get_time()); }
+static void IRAM_ATTR onFlow3() { channels[3].record((uint32_t)esp_timer_get_time()); }
+
+static void (*flowInterrupts[MAX_FLOW_SENSORS])() = {onFlow0, onFlow1, onFlow2, onFlow3};
+
+FlowCounter::FlowCounter() {
+    memset(lastSnapshot, 0, sizeof(lastSnapshot));
+}
+
+void FlowCounter::begin() {
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        pinMode(flowPins[i], INPUT_PULLUP);
+        lastSnapshot[i] = channels[i].count;
+        attachInterrupt(digitalPinToInterrupt(flowPins[i]), flowInterrupts[i], RISING);
+    }
+}
+
+uint32_t FlowCounter::total(int channel) const {
+    return channels[channel].count;
+}
+
+uint32_t FlowCounter::takeDelta(int channel) {
+    return channels[channel].takeDelta(lastSnapshot[channel]);
+}
+
+void FlowCounter::takeDeltas(uint32_t deltas[]) {
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        deltas[i] = takeDelta(i);
+    }
+}
+
+int FlowCounter::recentPulseTimes(int channel, uint32_t times[]) const {
+    return channels[channel].recentTimes(times);
+}
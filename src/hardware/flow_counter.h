@@ -0,0 +1,31 @@
+#ifndef FLOW_COUNTER_H
+#define FLOW_COUNTER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "pulse_channel.h"
+
+// Pulse counters for the flow sensors: one PulseChannel per input, so the
+// counters are never reset or detached. The recent pulse timestamps feed
+// period-based rate estimation.
+class FlowCounter {
+private:
+    uint32_t lastSnapshot[MAX_FLOW_SENSORS];
+
+public:
+    FlowCounter();
+    void begin();
+
+    // Raw monotonic pulse count since boot (wraps at 2^32)
+    uint32_t total(int channel) const;
+
+    // Pulses seen since the previous takeDelta() for this channel
+    uint32_t takeDelta(int channel);
+    void takeDeltas(uint32_t deltas[]);
+
+    // Copies up to FLOW_PULSE_HISTORY recent pulse times (esp_timer us,
+    // truncated to 32 bits), oldest first. Returns how many were copied.
+    int recentPulseTimes(int channel, uint32_t times[]) const;
+};
+
+#endif
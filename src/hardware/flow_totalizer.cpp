@@ -0,0 +1,39 @@
+#include "flow_totalizer.h"
+
+FlowTotalizer::FlowTotalizer() : prefs(nullptr), unsavedLiters(0), lastCheckpoint(0) {
+    memset(liters, 0, sizeof(liters));
+}
+
+void FlowTotalizer::begin(PreferencesManager* preferences) {
+    prefs = preferences;
+    if (prefs && prefs->loadFlowTotals(liters, MAX_FLOW_SENSORS)) {
+        Serial.printf("Flow totals restored: %.2f / %.2f / %.2f / %.2f L\n",
+                      liters[0], liters[1], liters[2], liters[3]);
+    }
+    lastCheckpoint = millis();
+}
+
+void FlowTotalizer::add(int channel, double volume) {
+    if (volume <= 0) return;
+    liters[channel] += volume;
+    unsavedLiters += volume;
+}
+
+double FlowTotalizer::total(int channel) {
+    return liters[channel];
+}
+
+void FlowTotalizer::checkpoint(bool force) {
+    if (!prefs || unsavedLiters <= 0) return;
+
+    unsigned long elapsed = millis() - lastCheckpoint;
+    if (!force) {
+        if (elapsed < TOTALIZER_MIN_INTERVAL) return;
+        if (unsavedLiters < TOTALIZER_CHECKPOINT_VOLUME && elapsed < TOTALIZER_MAX_INTERVAL) return;
+    }
+
+    if (prefs->saveFlowTotals(liters, MAX_FLOW_SENSORS)) {
+        unsavedLiters = 0;
+    }
+    lastCheckpoint = millis();
+}
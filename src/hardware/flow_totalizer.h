@@ -0,0 +1,26 @@
+#ifndef FLOW_TOTALIZER_H
+#define FLOW_TOTALIZER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "../storage/preferences_manager.h"
+
+// Cumulative volume per flow channel, persisted in NVS.
+// Writes are batched: at most one per TOTALIZER_MIN_INTERVAL, and only once
+// TOTALIZER_CHECKPOINT_VOLUME has accumulated or TOTALIZER_MAX_INTERVAL passed.
+class FlowTotalizer {
+private:
+    PreferencesManager* prefs;
+    double liters[MAX_FLOW_SENSORS];
+    double unsavedLiters;
+    unsigned long lastCheckpoint;
+
+public:
+    FlowTotalizer();
+    void begin(PreferencesManager* preferences);
+    void add(int channel, double volume);
+    double total(int channel);
+    void checkpoint(bool force = false);
+};
+
+#endif
@@ -0,0 +1,37 @@
+#include "leak_detector.h"
+
+LeakDetector::LeakDetector() : leakMask(0) {
+    memset(aboveCount, 0, sizeof(aboveCount));
+    memset(belowCount, 0, sizeof(belowCount));
+}
+
+uint8_t LeakDetector::update(const FlowSample& sample, uint8_t valveOpenMask, uint8_t& cleared) {
+    uint8_t started = 0;
+    cleared = 0;
+
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        uint8_t bit = 1 << i;
+        bool unexpected = !(valveOpenMask & bit) && sample.rates[i] > LEAK_FLOW_THRESHOLD;
+
+        if (unexpected) {
+            belowCount[i] = 0;
+            if (aboveCount[i] < LEAK_CONFIRM_SAMPLES) aboveCount[i]++;
+            if (aboveCount[i] >= LEAK_CONFIRM_SAMPLES && !(leakMask & bit)) {
+                leakMask |= bit;
+                started |= bit;
+            }
+        } else {
+            aboveCount[i] = 0;
+            if (belowCount[i] < LEAK_CONFIRM_SAMPLES) belowCount[i]++;
+            if (belowCount[i] >= LEAK_CONFIRM_SAMPLES && (leakMask & bit)) {
+                leakMask &= ~bit;
+                cleared |= bit;
+            }
+        }
+    }
+    return started;
+}
+
+uint8_t LeakDetector::activeMask() {
+    return leakMask;
+}
@@ -0,0 +1,34 @@
+#ifndef LEAK_DETECTOR_H
+#define LEAK_DETECTOR_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "sensor_manager.h"
+
+// Edge reported by the detector, passed from the sensing task to MQTT
+struct LeakEvent {
+    uint8_t channel;
+    bool active;
+    float flowRate;
+    double totalLiters;
+};
+
+// Flags flow on a channel whose valve is closed. A channel enters the leak
+// state after LEAK_CONFIRM_SAMPLES consecutive samples above the threshold
+// and leaves it after the same number below it; only the edges are reported.
+class LeakDetector {
+private:
+    uint8_t aboveCount[MAX_FLOW_SENSORS];
+    uint8_t belowCount[MAX_FLOW_SENSORS];
+    uint8_t leakMask;
+
+public:
+    LeakDetector();
+
+    // valveOpenMask: bit i set when valve i is open.
+    // Returns the channels that started leaking; cleared gets those that stopped.
+    uint8_t update(const FlowSample& sample, uint8_t valveOpenMask, uint8_t& cleared);
+    uint8_t activeMask();
+};
+
+#endif
@@ -1,59 +1,173 @@
 #include "led_controller.h"
 
-LEDController::LEDController() : pixels(NUMPIXELS, RGB_LED_PIN, NEO_GRB + NEO_KHZ800) {}
+// Predefined patterns
+static const LEDPattern WIFI_CONNECTED     = {0, 0, 255, 300, 300, 5, LED_PRIORITY_STATUS};   // Blue blink
+static const LEDPattern INTERNET_AVAILABLE = {0, 255, 0, 300, 300, 5, LED_PRIORITY_STATUS};   // Green blink
+static const LEDPattern VALIDATION_SUCCESS = {255, 255, 0, 300, 300, 3, LED_PRIORITY_STATUS}; // Yellow blink
+static const LEDPattern VALIDATION_FAILED  = {255, 0, 0, 300, 300, 3, LED_PRIORITY_ALERT};    // Red blink
+static const LEDPattern CONNECTION_FAILED  = {255, 0, 0, 300, 300, 5, LED_PRIORITY_ALERT};    // Red blink
+static const LEDPattern AP_MODE            = {0, 255, 0, 300, 300, 3, LED_PRIORITY_STATUS};   // Green blink
+static const LEDPattern RESET              = {255, 0, 0, 300, 300, 3, LED_PRIORITY_CRITICAL}; // Red blink
+
+LEDController::LEDController() : pixels(NUMPIXELS, RGB_LED_PIN, NEO_GRB + NEO_KHZ800),
+                                 tickTimer(nullptr), requests(nullptr), idle(true),
+                                 pendingCount(0), running(false), phaseOn(false),
+                                 cyclesLeft(0), phaseEnd(0), baseR(0), baseG(0), baseB(0) {}
 
 void LEDController::begin() {
     pixels.begin();
     pixels.clear();
     pixels.show();
+
+    requests = xQueueCreate(LED_QUEUE_LENGTH * 2, sizeof(Request));
+
+    esp_timer_create_args_t args = {};
+    args.callback = &LEDController::onTick;
+    args.arg = this;
+    args.name = "led";
+    esp_timer_create(&args, &tickTimer);
+    esp_timer_start_periodic(tickTimer, LED_TICK_INTERVAL * 1000ULL);
 }
 
-void LEDController::blinkRGB(uint8_t r, uint8_t g, uint8_t b, int times) {
-    for (int i = 0; i < times; i++) {
-        pixels.setPixelColor(0, pixels.Color(r, g, b));
-        pixels.show();
-        delay(300);
-        pixels.clear();
-        pixels.show();
-        delay(300);
+void LEDController::onTick(void* arg) {
+    static_cast<LEDController*>(arg)->tick();
+}
+
+void LEDController::tick() {
+    Request request;
+    while (xQueueReceive(requests, &request, 0) == pdTRUE) {
+        if (request.setBase) {
+            baseR = request.pattern.r;
+            baseG = request.pattern.g;
+            baseB = request.pattern.b;
+            if (!running) show(baseR, baseG, baseB);
+        } else {
+            if (running && request.pattern.priority > active.priority) {
+                running = false; // preempted
+            }
+            enqueue(request.pattern);
+        }
+    }
+
+    unsigned long now = millis();
+    if (running && (long)(now - phaseEnd) >= 0) {
+        if (phaseOn) {
+            show(0, 0, 0);
+            phaseOn = false;
+            phaseEnd = now + active.offMs;
+        } else if (--cyclesLeft > 0) {
+            show(active.r, active.g, active.b);
+            phaseOn = true;
+            phaseEnd = now + active.onMs;
+        } else {
+            running = false;
+            show(baseR, baseG, baseB);
+        }
+    }
+
+    if (!running && pendingCount > 0) {
+        startNext();
     }
+
+    idle = !running && pendingCount == 0 && uxQueueMessagesWaiting(requests) == 0;
 }
 
-void LEDController::setColor(uint8_t r, uint8_t g, uint8_t b) {
+// Keeps pending[] sorted by priority (highest first), FIFO within a priority
+void LEDController::enqueue(const LEDPattern& pattern) {
+    if (pendingCount == LED_QUEUE_LENGTH) {
+        if (pending[pendingCount - 1].priority >= pattern.priority) return; // drop newcomer
+        pendingCount--; // drop the lowest-priority pattern
+    }
+
+    int i = pendingCount;
+    while (i > 0 && pending[i - 1].priority < pattern.priority) {
+        pending[i] = pending[i - 1];
+        i--;
+    }
+    pending[i] = pattern;
+    pendingCount++;
+}
+
+void LEDController::startNext() {
+    active = pending[0];
+    for (int i = 1; i < pendingCount; i++) pending[i - 1] = pending[i];
+    pendingCount--;
+
+    if (active.repeats == 0) {
+        show(baseR, baseG, baseB);
+        return;
+    }
+
+    running = true;
+    phaseOn = true;
+    cyclesLeft = active.repeats;
+    phaseEnd = millis() + active.onMs;
+    show(active.r, active.g, active.b);
+}
+
+void LEDController::show(uint8_t r, uint8_t g, uint8_t b) {
     pixels.setPixelColor(0, pixels.Color(r, g, b));
     pixels.show();
 }
 
+void LEDController::submit(const Request& request) {
+    if (!requests) return;
+    xQueueSend(requests, &request, 0);
+    idle = false;
+}
+
+void LEDController::play(const LEDPattern& pattern) {
+    Request request = {pattern, false};
+    submit(request);
+}
+
+void LEDController::blinkRGB(uint8_t r, uint8_t g, uint8_t b, int times) {
+    LEDPattern pattern = {r, g, b, 300, 300, (uint8_t)times, LED_PRIORITY_STATUS};
+    play(pattern);
+}
+
+void LEDController::setColor(uint8_t r, uint8_t g, uint8_t b) {
+    Request request = {{r, g, b, 0, 0, 0, 0}, true};
+    submit(request);
+}
+
 void LEDController::clear() {
-    pixels.clear();
-    pixels.show();
+    setColor(0, 0, 0);
+}
+
+bool LEDController::waitUntilIdle(unsigned long timeoutMs) {
+    unsigned long start = millis();
+    while (!idle) {
+        if (millis() - start >= timeoutMs) return false;
+        delay(LED_TICK_INTERVAL);
+    }
+    return true;
 }
 
-// Predefined patterns
 void LEDController::blinkWiFiConnected() {
-    blinkRGB(0, 0, 255, 5); // Blue blink
+    play(WIFI_CONNECTED);
 }
 
 void LEDController::blinkInternetAvailable() {
-    blinkRGB(0, 255, 0, 5); // Green blink
+    play(INTERNET_AVAILABLE);
 }
 
 void LEDController::blinkValidationSuccess() {
-    blinkRGB(255, 255, 0, 3); // Yellow blink
+    play(VALIDATION_SUCCESS);
 }
 
 void LEDController::blinkValidationFailed() {
-    blinkRGB(255, 0, 0, 3); // Red blink
+    play(VALIDATION_FAILED);
 }
 
 void LEDController::blinkConnectionFailed() {
-    blinkRGB(255, 0, 0, 5); // Red blink
+    play(CONNECTION_FAILED);
 }
 
 void LEDController::blinkAPMode() {
-    blinkRGB(0, 255, 0, 3); // Green blink
+    play(AP_MODE);
 }
 
 void LEDController::blinkReset() {
-    blinkRGB(255, 0, 0, 3); // Red blink
+    play(RESET);
 }
@@ -2,19 +2,68 @@
 #define LED_CONTROLLER_H
 
 #include <Adafruit_NeoPixel.h>
+#include <esp_timer.h>
 #include "config.h"
 
+enum LEDPriority : uint8_t {
+    LED_PRIORITY_STATUS = 1,    // progress indications
+    LED_PRIORITY_ALERT = 2,     // failures
+    LED_PRIORITY_CRITICAL = 3   // reset / restart
+};
+
+// Declarative blink pattern: `repeats` on/off cycles of the given color
+struct LEDPattern {
+    uint8_t r, g, b;
+    uint16_t onMs;
+    uint16_t offMs;
+    uint8_t repeats;
+    uint8_t priority;
+};
+
+// Patterns are queued from any task and rendered by a periodic esp_timer
+// tick, so callers never wait. A higher-priority pattern preempts the one
+// playing; otherwise they play in priority order, FIFO within a priority.
+// Between patterns the LED shows the color last set with setColor().
 class LEDController {
 private:
+    struct Request {
+        LEDPattern pattern;
+        bool setBase;
+    };
+
     Adafruit_NeoPixel pixels;
+    esp_timer_handle_t tickTimer;
+    QueueHandle_t requests;
+    volatile bool idle;
+
+    // Owned by the tick
+    LEDPattern pending[LED_QUEUE_LENGTH];
+    int pendingCount;
+    LEDPattern active;
+    bool running;
+    bool phaseOn;
+    uint8_t cyclesLeft;
+    unsigned long phaseEnd;
+    uint8_t baseR, baseG, baseB;
+
+    static void onTick(void* arg);
+    void tick();
+    void enqueue(const LEDPattern& pattern);
+    void startNext();
+    void show(uint8_t r, uint8_t g, uint8_t b);
+    void submit(const Request& request);
 
 public:
     LEDController();
     void begin();
+    void play(const LEDPattern& pattern);
     void blinkRGB(uint8_t r, uint8_t g, uint8_t b, int times);
     void setColor(uint8_t r, uint8_t g, uint8_t b);
     void clear();
-    
+
+    // Blocks until every queued pattern has played (e.g. before a restart)
+    bool waitUntilIdle(unsigned long timeoutMs);
+
     // Predefined color patterns
     void blinkWiFiConnected();
     void blinkInternetAvailable();
@@ -25,4 +74,4 @@ public:
     void blinkReset();
 };
 
-#endif
\ No newline at end of file
+#endif
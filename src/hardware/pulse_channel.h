@@ -0,0 +1,61 @@
+#ifndef PULSE_CHANNEL_H
+#define PULSE_CHANNEL_H
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+
+#ifdef ARDUINO
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#endif
+
+// Pulse state of one flow channel, shared by its ISR and the sampling task
+// without masking interrupts. The ISR is the only writer and only ever
+// increments the counter; readers keep their own snapshot and take the
+// (wrap-safe) difference. The ISR also keeps the timestamps of the last
+// FLOW_PULSE_HISTORY pulses, indexed by the counter itself.
+// No Arduino types here, so the protocol is unit-tested on the host.
+struct PulseChannel {
+    volatile uint32_t count;
+    volatile uint32_t times[FLOW_PULSE_HISTORY];
+
+    // ISR side. The timestamp is written before the count is published, so a
+    // reader that sees count n can trust slot (n - 1) % FLOW_PULSE_HISTORY.
+    inline void IRAM_ATTR record(uint32_t nowUs) {
+        uint32_t n = count;
+        times[n % FLOW_PULSE_HISTORY] = nowUs;
+        count = n + 1;
+    }
+
+    // Pulses since the previous call with the same snapshot. A 32-bit aligned
+    // load is atomic on the ESP32-C3, and unsigned math handles the wrap.
+    inline uint32_t takeDelta(uint32_t& snapshot) const {
+        uint32_t now = count;
+        uint32_t delta = now - snapshot;
+        snapshot = now;
+        return delta;
+    }
+
+    // Copies up to FLOW_PULSE_HISTORY recent pulse times, oldest first.
+    // Returns how many were copied.
+    inline int recentTimes(uint32_t out[]) const {
+        uint32_t head = count;
+        uint32_t n = head < FLOW_PULSE_HISTORY ? head : FLOW_PULSE_HISTORY;
+
+        for (uint32_t k = 0; k < n; k++) {
+            out[k] = times[(head - n + k) % FLOW_PULSE_HISTORY];
+        }
+
+        // Pulses that arrived while copying overwrote the oldest slots; drop them
+        uint32_t overwritten = count - head;
+        if (overwritten >= n) return 0;
+        if (overwritten > 0) {
+            memmove(out, out + overwritten, (n - overwritten) * sizeof(uint32_t));
+        }
+        return n - overwritten;
+    }
+};
+
+#endif
@@ -1,49 +1,197 @@
 #include "sensor_manager.h"
 #include <OneWire.h>
 #include <DallasTemperature.h>
+#include <esp_timer.h>
 
-#define TOTAL_SENSORS 4
-int flowPins[TOTAL_SENSORS] = {6, 7, 10, 18};
-volatile int flowCounts[TOTAL_SENSORS] = {0};
-
-void IRAM_ATTR onFlow0() { flowCounts[0]++; }
-void IRAM_ATTR onFlow1() { flowCounts[1]++; }
-void IRAM_ATTR onFlow2() { flowCounts[2]++; }
-void IRAM_ATTR onFlow3() { flowCounts[3]++; }
+OneWire oneWire(ONE_WIRE_BUS);
+DallasTemperature sensors(&oneWire);
 
-void (*flowInterrupts[])() = {onFlow0, onFlow1, onFlow2, onFlow3};
+// Calibrations are replaced from the MQTT task while the sensing task reads them
+static portMUX_TYPE calibrationLock = portMUX_INITIALIZER_UNLOCKED;
 
-OneWire oneWire(1); // TEMP_SENSOR_PIN
-DallasTemperature sensors(&oneWire);
+SensorManager::SensorManager() : prefs(nullptr), lastSampleUs(0), tempState(TempState::IDLE),
+                                 conversionStarted(0), conversionTime(0), probeCount(0) {
+    for (int i = 0; i < MAX_TEMP_PROBES; i++) {
+        probeTemperatures[i] = DEVICE_DISCONNECTED_C;
+        probeOk[i] = false;
+    }
+}
 
-void SensorManager::begin() {
+void SensorManager::begin(PreferencesManager* preferences) {
+    prefs = preferences;
     gpio_install_isr_service(0);
 
-    for (int i = 0; i < TOTAL_SENSORS; i++) {
-        pinMode(flowPins[i], INPUT_PULLUP);
-        attachInterrupt(digitalPinToInterrupt(flowPins[i]), flowInterrupts[i], RISING);
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        if (prefs->loadFlowCalibration(i, calibrations[i])) {
+            Serial.printf("Flow sensor %d: %d-point calibration loaded\n", i + 1, calibrations[i].count);
+        }
     }
+    totalizer.begin(prefs);
+
+    flowCounter.begin();
+    lastSampleUs = esp_timer_get_time();
 
     sensors.begin();
+    enumerateProbes();
+    sensors.setResolution(TEMP_RESOLUTION);
+    sensors.setWaitForConversion(false);
+
+    conversionTime = TEMP_CONVERSION_TIME > 0 ? TEMP_CONVERSION_TIME
+                                              : sensors.millisToWaitForConversion(TEMP_RESOLUTION);
+    Serial.printf("DS18B20: %d-bit, %lu ms conversion\n", TEMP_RESOLUTION, conversionTime);
+}
+
+// Single search pass over the bus; the cached addresses avoid a search per read
+void SensorManager::enumerateProbes() {
+    DeviceAddress address;
+    probeCount = 0;
+
+    oneWire.reset_search();
+    while (probeCount < MAX_TEMP_PROBES && oneWire.search(address)) {
+        if (!sensors.validAddress(address) || !sensors.validFamily(address)) continue;
+
+        memcpy(probeAddresses[probeCount], address, sizeof(DeviceAddress));
+        probeOk[probeCount] = true; // present on the bus until a read fails
+        Serial.printf("DS18B20 probe %d: %02X%02X%02X%02X%02X%02X%02X%02X\n", probeCount,
+                      address[0], address[1], address[2], address[3],
+                      address[4], address[5], address[6], address[7]);
+        probeCount++;
+    }
+    oneWire.reset_search();
+
+    Serial.printf("Found %d temperature probe(s)\n", probeCount);
+}
+
+// Drives the temperature conversion without ever waiting on the 1-Wire bus
+bool SensorManager::update() {
+    totalizer.checkpoint();
+
+    switch (tempState) {
+        case TempState::IDLE:
+            if (probeCount > 0 && millis() - conversionStarted >= TEMP_READ_INTERVAL) {
+                sensors.requestTemperatures(); // skip-ROM: all probes convert together
+                conversionStarted = millis();
+                tempState = TempState::CONVERTING;
+            }
+            break;
+
+        case TempState::CONVERTING:
+            if (millis() - conversionStarted >= conversionTime) {
+                for (int i = 0; i < probeCount; i++) {
+                    float temp = sensors.getTempC(probeAddresses[i]);
+                    probeOk[i] = (temp != DEVICE_DISCONNECTED_C && temp > -55 && temp < 125);
+                    if (probeOk[i]) probeTemperatures[i] = temp;
+                }
+                tempState = TempState::IDLE;
+                return true;
+            }
+            break;
+    }
+    return false;
+}
+
+
+void SensorManager::sampleFlow(FlowSample& sample) {
+    flowCounter.takeDeltas(sample.pulses);
+    int64_t now = esp_timer_get_time();
+
+    // The first window can span the whole time since begin()
+    int64_t elapsed = now - lastSampleUs;
+    sample.timestampUs = now;
+    sample.windowUs = elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed;
+    lastSampleUs = now;
+
+    float seconds = sample.windowUs / 1e6f;
+    sample.periodMask = 0;
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        float countHz = seconds > 0 ? sample.pulses[i] / seconds : 0;
+        float hz = countHz;
+        if (countHz < FLOW_PERIOD_MODE_HZ) {
+            // Too few pulses for counting to be precise; use their spacing
+            hz = estimatePeriodHz(i, (uint32_t)now);
+            sample.periodMask |= (1 << i);
+        }
+        portENTER_CRITICAL(&calibrationLock);
+        sample.rates[i] = calibrations[i].toLitersPerMinute(hz);
+        float countedLpm = calibrations[i].toLitersPerMinute(countHz);
+        portEXIT_CRITICAL(&calibrationLock);
+
+        // Volume comes from the pulses actually counted, never from the
+        // period estimate, which decays for a while after the flow stops
+        totalizer.add(i, countedLpm * seconds / 60.0);
+        sample.totalLiters[i] = totalizer.total(i);
+    }
 }
 
+// Pulse frequency from the intervals between the most recent pulses.
+// The time since the last pulse bounds the current period from below, so the
+// estimate decays toward zero as soon as the flow stops.
+float SensorManager::estimatePeriodHz(int channel, uint32_t nowUs) {
+    uint32_t times[FLOW_PULSE_HISTORY];
+    int n = flowCounter.recentPulseTimes(channel, times);
+
+    const uint32_t maxAgeUs = FLOW_PULSE_MAX_AGE * 1000UL;
+    int first = 0;
+    while (first < n && nowUs - times[first] > maxAgeUs) first++;
+
+    if (n - first < 2) return 0;
+
+    uint32_t span = times[n - 1] - times[first];
+    if (span == 0) return 0;
 
-void SensorManager::readFlowRates(float rates[]) {
-    for (int i = 0; i < TOTAL_SENSORS; i++) {
-        detachInterrupt(digitalPinToInterrupt(flowPins[i]));
-        rates[i] = flowCounts[i] / 7.5;
-        flowCounts[i] = 0;
-        attachInterrupt(digitalPinToInterrupt(flowPins[i]), flowInterrupts[i], RISING);
+    float hz = (n - first - 1) * 1e6f / span;
+
+    uint32_t sinceLast = nowUs - times[n - 1];
+    if (sinceLast > span / (n - first - 1)) {
+        hz = min(hz, 1e6f / sinceLast);
     }
+    return hz;
+}
+
+void SensorManager::readTemperatures(TemperatureSample& sample) {
+    sample.count = probeCount;
+    for (int i = 0; i < probeCount; i++) {
+        sample.values[i] = probeTemperatures[i];
+        sample.ok[i] = probeOk[i];
+    }
+}
+
+int SensorManager::getProbeCount() {
+    return probeCount;
+}
+
+void SensorManager::getProbeAddress(int index, uint8_t address[8]) {
+    memcpy(address, probeAddresses[index], 8);
 }
 
-float SensorManager::readTemperature() {
-    sensors.requestTemperatures();
-    return sensors.getTempCByIndex(0);
+// Healthy until a conversion has failed to read back; no bus traffic here
+bool SensorManager::isProbeHealthy(int index) {
+    return index < probeCount && probeOk[index];
 }
 
 bool SensorManager::isTemperatureSensorConnected() {
-    sensors.requestTemperatures();
-    float temp = sensors.getTempCByIndex(0);
-    return (temp != DEVICE_DISCONNECTED_C && temp > -55 && temp < 125);
+    for (int i = 0; i < probeCount; i++) {
+        if (isProbeHealthy(i)) return true;
+    }
+    return false;
+}
+
+bool SensorManager::setCalibration(int channel, const FlowCalibration& cal) {
+    if (channel < 0 || channel >= MAX_FLOW_SENSORS || !cal.isValid()) return false;
+    if (!prefs->saveFlowCalibration(channel, cal)) return false;
+
+    portENTER_CRITICAL(&calibrationLock);
+    calibrations[channel] = cal;
+    portEXIT_CRITICAL(&calibrationLock);
+    Serial.printf("Flow sensor %d: calibration updated (%d points)\n", channel + 1, cal.count);
+    return true;
+}
+
+double SensorManager::getTotalLiters(int channel) {
+    return totalizer.total(channel);
+}
+
+// Forces a totalizer write, e.g. right before an intentional restart
+void SensorManager::checkpointTotals() {
+    totalizer.checkpoint(true);
 }
@@ -2,13 +2,70 @@
 #define SENSOR_MANAGER_H
 
 #include <Arduino.h>
+#include "flow_counter.h"
+#include "flow_calibration.h"
+#include "flow_totalizer.h"
+#include "../storage/preferences_manager.h"
+
+// One flow snapshot. Rates are normalized by the measured window, so the
+// backend can weight samples by windowUs when it aggregates them.
+struct FlowSample {
+    float rates[MAX_FLOW_SENSORS];      // L/min
+    uint32_t pulses[MAX_FLOW_SENSORS];  // pulses seen in the window
+    int64_t timestampUs;                // esp_timer time at end of window
+    uint32_t windowUs;                  // window length
+    uint8_t periodMask;                 // bit i set: channel i estimated from pulse intervals
+    double totalLiters[MAX_FLOW_SENSORS]; // cumulative volume at end of window
+};
+
+// Latest per-probe temperatures, in bus enumeration order
+struct TemperatureSample {
+    int count;
+    float values[MAX_TEMP_PROBES];      // °C, last good value
+    bool ok[MAX_TEMP_PROBES];           // last conversion read back valid
+};
+
+enum class TempState {
+    IDLE,
+    CONVERTING
+};
 
 class SensorManager {
+private:
+    PreferencesManager* prefs;
+    FlowCounter flowCounter;
+    FlowCalibration calibrations[MAX_FLOW_SENSORS];
+    FlowTotalizer totalizer;
+    int64_t lastSampleUs;
+
+    // DS18B20 conversions run in the background; readers get the last good value.
+    // Probe ROM addresses are enumerated once and read by address afterwards.
+    TempState tempState;
+    unsigned long conversionStarted;
+    unsigned long conversionTime;
+    int probeCount;
+    uint8_t probeAddresses[MAX_TEMP_PROBES][8];
+    float probeTemperatures[MAX_TEMP_PROBES];
+    bool probeOk[MAX_TEMP_PROBES];
+
+    void enumerateProbes();
+    float estimatePeriodHz(int channel, uint32_t nowUs);
+
 public:
-    void begin();
+    SensorManager();
+    void begin(PreferencesManager* preferences);
+    bool update(); // true when a fresh set of temperatures is available
     bool isTemperatureSensorConnected();
-    void readFlowRates(float rates[]);
-    float readTemperature();
+    void sampleFlow(FlowSample& sample);
+    void readTemperatures(TemperatureSample& sample);
+    int getProbeCount();
+    void getProbeAddress(int index, uint8_t address[8]);
+    bool isProbeHealthy(int index);
+
+    // Calibration and cumulative volume
+    bool setCalibration(int channel, const FlowCalibration& cal);
+    double getTotalLiters(int channel);
+    void checkpointTotals();
 };
 
 #endif
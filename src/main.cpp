@@ -1,5 +1,7 @@
 #include <Arduino.h>
 #include <Adafruit_NeoPixel.h>
+#include <esp_timer.h>
+#include <esp_system.h>
 #include "config.h"
 #include "hardware/led_controller.h"
 #include "hardware/button_handler.h"
@@ -9,7 +11,12 @@
 #include "web/web_server.h"
 #include "network/mqtt_manager.h"
 #include "hardware/sensor_manager.h"
+#include "hardware/leak_detector.h"
+#include "telemetry/stats_aggregator.h"
+#include "telemetry/report_filter.h"
 #include "network/http_client.h"
+#include "network/request_queue.h"
+#include "storage/telemetry_store.h"
 #include "../include/hardware_status.h"
 
 
@@ -21,26 +28,64 @@ WiFiManager wifiManager;
 APIClient apiClient;
 WebServerManager webServer;
 MQTTManager mqttManager;
+RequestQueue requestQueue;  // outbound HTTP for apiClient and httpClient
 
 // Device configuration
 DeviceConfig deviceConfig;
 bool validationSuccess = false;
+volatile int validationResult = 0;  // HTTP status from the validation request; 0 while pending
+bool validationPending = false;
+bool networkReady = false;  // post-connect setup done; later reconnects skip it
 unsigned long lastHeartbeat = 0;
-const unsigned long HEARTBEAT_INTERVAL = 30000;
+uint32_t maxControlLoopUs = 0;  // reset by each heartbeat
+
+// Runtime tasks and the queues between them
+TaskHandle_t webTaskHandle = nullptr;   // the Arduino loop task
+TaskHandle_t sensingTaskHandle = nullptr;
+TaskHandle_t controlTaskHandle = nullptr;
+TaskHandle_t uplinkTaskHandle = nullptr;
+TaskHandle_t uiTaskHandle = nullptr;
+QueueHandle_t telemetryQueue = nullptr;
+QueueHandle_t alarmQueue = nullptr;
 
 SensorManager sensorManager;
 HTTPClientManager httpClient;
-float flowRates[MAX_FLOW_SENSORS];
+TelemetryStore telemetryStore;  // owned by the uplink task
+
+// Owned by the sensing task
+FlowSample flowSample;
+TemperatureSample temperatureSample;
+LeakDetector leakDetector;
+StatsAggregator statsAggregator;
+TelemetrySummary telemetrySummary;
+ReportFilter reportFilter;
 
 // Function declarations
 void handleDeviceSetup();
-void handleWiFiConnection();
+void startWiFiConnection();
+void superviseWiFi();
+void onWiFiConnected();
+void onWiFiFailed();
 void handleDeviceValidation();
+void onValidationComplete(int httpCode, void* context);
+void superviseValidation();
 void handleResetButton();
 void onCredentialsSaved(const String& ssid, const String& password, 
                        const String& customer_uid, const String& device_number);
 void performHeartbeat();
-void handleOperationalMode();
+void performHardwareCheck();
+void startSensingTask();
+void startOperationalTasks();
+void reportTaskStacks();
+void printHistogram(const char* label, const LatencyHistogram& histogram);
+void checkForLeaks(uint8_t valveOpenMask);
+void publishSummary();
+void sensingTask(void* parameter);
+void controlTask(void* parameter);
+void uplinkTask(void* parameter);
+void drainTelemetryStore();
+bool deliverTelemetry(const TelemetrySummary summaries[], int count, bool replayed);
+void uiTask(void* parameter);
 
 void setup() {
     Serial.begin(115200);
@@ -48,11 +93,17 @@ void setup() {
     Serial.println("=== Green Mesh IoT Device Starting ===");
     Serial.printf("Free heap: %d bytes\n", ESP.getFreeHeap());
 
+    // setup() and loop() run in the Arduino loop task, which serves web/DNS
+    webTaskHandle = xTaskGetCurrentTaskHandle();
+    vTaskPrioritySet(nullptr, WEB_TASK_PRIORITY);
+
     // Initialize hardware
     ledController.begin();
     buttonHandler.begin();
+    xTaskCreate(uiTask, "ui", UI_TASK_STACK, nullptr, UI_TASK_PRIORITY, &uiTaskHandle);
 
-    sensorManager.begin();
+    sensorManager.begin(&prefsManager);
+    mqttManager.beginValves();
 
     // Startup LED indication
     // ledController.setColor(255, 255, 0); // Yellow during startup
@@ -61,6 +112,11 @@ void setup() {
     webServer.setPreferencesManager(&prefsManager);
     webServer.setLEDController(&ledController);
     webServer.setCredentialsSavedCallback(onCredentialsSaved);
+    wifiManager.setPreferencesManager(&prefsManager);
+    mqttManager.setSensorManager(&sensorManager);
+    requestQueue.begin(&httpClient.getSession());
+    httpClient.setRequestQueue(&requestQueue);
+    apiClient.setRequestQueue(&requestQueue);
 
     // Check if reset button is pressed during boot
     if (buttonHandler.isPressedDuringBoot()) {
@@ -85,37 +141,21 @@ void setup() {
     Serial.println("Is Onboarded: " + String(deviceConfig.isOnboarded));
     Serial.println("Is First Boot: " + String(deviceConfig.isFirstBoot));
 
-    // Try to connect to stored WiFi
-    handleWiFiConnection();
+    // Metering and leak detection never wait for the network
+    if (deviceConfig.isOnboarded) startSensingTask();
+
+    // Try to connect to stored WiFi; loop() picks up the result
+    startWiFiConnection();
 }
 
+// Web/DNS task. Sensing, MQTT, uploads and the button run in their own tasks;
+// WiFi is supervised here without blocking.
 void loop() {
-    // Handle web server
     webServer.handleClient();
+    superviseWiFi();
+    superviseValidation();
 
-    // Check reset button in normal operation mode
-    if (webServer.getCurrentMode() != ServerMode::SETUP_MODE) {
-        if (buttonHandler.checkForReset()) {
-            Serial.println("Reset button pressed during operation. Resetting device...");
-            prefsManager.clearAll();
-            ledController.blinkReset();
-            delay(1000);
-            ESP.restart();
-        }
-    }
-
-    // Handle operational tasks if device is onboarded and connected
-    if (deviceConfig.isOnboarded && wifiManager.isConnected()) {
-        handleOperationalMode();
-    }
-
-    // WiFi connection monitoring
-    if (!wifiManager.isConnected() && deviceConfig.isOnboarded) {
-        Serial.println("WiFi connection lost. Attempting to reconnect...");
-        handleWiFiConnection();
-    }
-
-    delay(100);
+    delay(WEB_TASK_PERIOD);
 }
 
 void handleDeviceSetup() {
@@ -141,55 +181,103 @@ void handleDeviceSetup() {
     }
 }
 
-void handleWiFiConnection() {
+void startWiFiConnection() {
     Serial.println("=== Attempting WiFi Connection ===");
     Serial.println("Connecting to: " + deviceConfig.ssid);
 
     ledController.setColor(0, 0, 255); // Blue while connecting
 
-    WiFiState wifiState = wifiManager.connectToWiFi(deviceConfig.ssid, deviceConfig.password);
+    wifiManager.begin(deviceConfig.ssid, deviceConfig.password);
+}
 
-    if (wifiState == WiFiState::CONNECTED) {
-        Serial.println("WiFi Connected successfully.");
-        Serial.println("IP Address: " + wifiManager.getLocalIP());
-        Serial.println("Signal Strength: " + String(WiFi.RSSI()) + " dBm");
-        ledController.blinkWiFiConnected();
+// Reacts to WiFi state transitions; reconnects happen inside WiFiManager
+void superviseWiFi() {
+    static WiFiState lastState = WiFiState::DISCONNECTED;
 
-        if (apiClient.hasInternetConnection()) {
-            Serial.println("Internet connection verified.");
-            ledController.blinkInternetAvailable();
+    WiFiState state = wifiManager.loop();
+    if (state == lastState) return;
+    lastState = state;
 
-            mqttManager.begin(&prefsManager);
+    if (state == WiFiState::CONNECTED) {
+        onWiFiConnected();
+    } else if (state == WiFiState::FAILED) {
+        onWiFiFailed();
+    } else if (state == WiFiState::DISCONNECTED && networkReady) {
+        Serial.println("WiFi connection lost. Reconnecting in background...");
+    }
+}
 
-            performHardwareCheck();
+void onWiFiConnected() {
+    Serial.println("WiFi Connected successfully.");
+    Serial.println("IP Address: " + wifiManager.getLocalIP());
+    Serial.println("Signal Strength: " + String(WiFi.RSSI()) + " dBm");
+    Serial.printf("Connect time: %lu ms (avg %lu ms, %u failures, %u drops)\n",
+                  wifiManager.getLastConnectTime(), wifiManager.getAverageConnectTime(),
+                  wifiManager.getFailureCount(), wifiManager.getDisconnectCount());
 
-            if (deviceConfig.isFirstBoot || !deviceConfig.isOnboarded) {
-                handleDeviceValidation();
-            } else {
-                Serial.println("Device already onboarded. Entering operational mode.");
-                webServer.startSuccessMode(deviceConfig, wifiManager.getLocalIP());
-            }
+    if (networkReady) {
+        apiClient.getConnectivityProbe().refresh(); // re-check in the background
+        return;
+    }
+
+    ledController.clear();
+    ledController.blinkWiFiConnected();
+
+    if (apiClient.hasInternetConnection()) {
+        Serial.println("Internet connection verified.");
+        ledController.blinkInternetAvailable();
+
+        mqttManager.begin(&prefsManager);
+
+        performHardwareCheck();
+        networkReady = true;
+
+        if (deviceConfig.isFirstBoot || !deviceConfig.isOnboarded) {
+            handleDeviceValidation();
         } else {
-            Serial.println("No internet connection available.");
-            ledController.blinkConnectionFailed();
-            delay(5000);
-            handleDeviceSetup();
+            Serial.println("Device already onboarded. Entering operational mode.");
+            webServer.startSuccessMode(deviceConfig, wifiManager.getLocalIP());
+            startOperationalTasks();
         }
     } else {
-        Serial.println("WiFi connection failed.");
-        Serial.println("Reason: " + String(WiFi.status()));
+        Serial.println("No internet connection available.");
         ledController.blinkConnectionFailed();
         delay(5000);
         handleDeviceSetup();
     }
 }
 
+void onWiFiFailed() {
+    Serial.println("WiFi connection failed.");
+    Serial.println("Reason: " + String(WiFi.status()));
+    ledController.blinkConnectionFailed();
+    delay(5000);
+    handleDeviceSetup();
+}
+
 void handleDeviceValidation() {
     Serial.println("=== Performing Device Validation ===");
     Serial.println("This is a first-time setup or re-validation.");
 
-    if (apiClient.validateDevice(deviceConfig.customer_uid, deviceConfig.device_number, 
-                               deviceConfig.ssid, deviceConfig.password)) {
+    // Answered on the request task; superviseValidation() picks up the result
+    validationResult = 0;
+    validationPending = true;
+    if (!apiClient.validateDevice(deviceConfig.customer_uid, deviceConfig.device_number,
+                                  deviceConfig.ssid, deviceConfig.password, onValidationComplete, nullptr)) {
+        validationResult = REQUEST_EXPIRED; // could not be queued; handled as a failure
+    }
+}
+
+void onValidationComplete(int httpCode, void* context) {
+    validationResult = httpCode != 0 ? httpCode : -1;
+}
+
+void superviseValidation() {
+    if (!validationPending || validationResult == 0) return;
+    validationPending = false;
+    Serial.printf("Validation finished with code %d\n", validationResult);
+
+    if (validationResult == 200) {
         validationSuccess = true;
         prefsManager.markAsOnboarded();
         prefsManager.markFirstBootComplete();
@@ -201,6 +289,7 @@ void handleDeviceValidation() {
         Serial.println("Device is now onboarded and operational.");
 
         webServer.startSuccessMode(deviceConfig, wifiManager.getLocalIP());
+        startOperationalTasks();
     } else {
         Serial.println("Device validation failed.");
         ledController.blinkValidationFailed();
@@ -209,54 +298,267 @@ void handleDeviceValidation() {
     }
 }
 
-void handleOperationalMode() {
-    mqttManager.loop();
+// Onboarded devices start sensing from setup(), whatever the network does;
+// summaries and alarms wait in the queues until the other tasks are up
+void startSensingTask() {
+    if (sensingTaskHandle) return;
+
+    telemetryQueue = xQueueCreate(TELEMETRY_QUEUE_LENGTH, sizeof(TelemetrySummary));
+    alarmQueue = xQueueCreate(ALARM_QUEUE_LENGTH, sizeof(LeakEvent));
+
+    xTaskCreate(sensingTask, "sensing", SENSING_TASK_STACK, nullptr, SENSING_TASK_PRIORITY, &sensingTaskHandle);
+}
+
+// Started once; the tasks keep running across WiFi drops
+void startOperationalTasks() {
+    if (controlTaskHandle) return;
+
+    startSensingTask(); // already running unless the device was just validated
+    xTaskCreate(controlTask, "control", CONTROL_TASK_STACK, nullptr, CONTROL_TASK_PRIORITY, &controlTaskHandle);
+    xTaskCreate(uplinkTask, "uplink", UPLINK_TASK_STACK, nullptr, UPLINK_TASK_PRIORITY, &uplinkTaskHandle);
+
+    Serial.println("Operational tasks started");
+}
+
+// Flow is sampled in every valve state so leaks and totals are never missed;
+// summaries are only queued for upload while a valve is open or a leak is active
+void sensingTask(void* parameter) {
+    TickType_t lastWake = xTaskGetTickCount();
+    unsigned long lastSend = millis();
+
+    for (;;) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(FLOW_SAMPLE_INTERVAL));
+
+        if (sensorManager.update()) {
+            sensorManager.readTemperatures(temperatureSample);
+            statsAggregator.addTemperatures(temperatureSample);
+        }
+
+        sensorManager.sampleFlow(flowSample);
+        statsAggregator.addFlow(flowSample);
+        checkForLeaks(mqttManager.getValveOpenMask());
+
+        if (millis() - lastSend >= TELEMETRY_INTERVAL && statsAggregator.hasData()) {
+            lastSend = millis();
+            statsAggregator.takeSummary(telemetrySummary);
+            publishSummary();
+        }
+    }
+}
+
+void publishSummary() {
+    bool leaking = leakDetector.activeMask() != 0;
+    if (!mqttManager.getValveOpenMask() && !leaking) return;
 
-    // Heartbeat every 30 sec
-    if (millis() - lastHeartbeat > HEARTBEAT_INTERVAL) {
-        performHeartbeat();
-        lastHeartbeat = millis();
+    // Leaks bypass the deadband so every period is reported
+    if (!leaking && !reportFilter.shouldReport(telemetrySummary)) return;
+    telemetrySummary.leakMask = leakDetector.activeMask();
+
+    // A slow uplink never blocks sampling: the oldest summary makes room
+    if (xQueueSend(telemetryQueue, &telemetrySummary, 0) != pdTRUE) {
+        static TelemetrySummary dropped;
+        xQueueReceive(telemetryQueue, &dropped, 0);
+        xQueueSend(telemetryQueue, &telemetrySummary, 0);
     }
+}
+
+void controlTask(void* parameter) {
+    LeakEvent event;
 
-    // ✅ Send flow/temperature every 2 seconds only if any valve is ON
-    static unsigned long lastSend = 0;
-    if (millis() - lastSend > 2000) {
+    for (;;) {
+        int64_t started = esp_timer_get_time();
 
-        // Check if any valve is ON
-        bool anyValveOn = false;
-        int valvePins[] = VALVE_PINS;
+        if (wifiManager.isConnected()) {
+            mqttManager.loop();
 
-        for (int i = 0; i < MAX_VALVES; i++) {
-            if (digitalRead(valvePins[i]) == LOW) {
-                anyValveOn = true;
-                break;
+            if (millis() - lastHeartbeat > HEARTBEAT_INTERVAL) {
+                performHeartbeat();
+                lastHeartbeat = millis();
             }
         }
 
-        if (anyValveOn) {
-            float temperature = sensorManager.readTemperature();
-            sensorManager.readFlowRates(flowRates);
+        while (xQueueReceive(alarmQueue, &event, 0) == pdTRUE) {
+            mqttManager.publishLeakAlarm(event);
+            if (event.active && LEAK_AUTO_SHUTOFF) {
+                mqttManager.closeAllValves();
+            }
+        }
 
-            httpClient.sendSensorData(deviceConfig.device_number, flowRates, MAX_FLOW_SENSORS, temperature);
-            lastSend = millis();
+        uint32_t elapsed = esp_timer_get_time() - started;
+        if (elapsed > maxControlLoopUs) maxControlLoopUs = elapsed;
+        vTaskDelay(pdMS_TO_TICKS(CONTROL_TASK_PERIOD));
+    }
+}
+
+// Live summaries go straight out; anything that cannot be delivered is kept
+// in flash and replayed in bounded batches once the backend is reachable.
+// Summaries are batched to amortize the per-request radio and HTTP overhead;
+// a partial batch goes out after UPLINK_BATCH_WINDOW or as soon as a leak shows up
+void uplinkTask(void* parameter) {
+    static TelemetrySummary batch[UPLINK_BATCH_SIZE];
+    int batched = 0;
+    unsigned long batchStart = 0;
+    telemetryStore.begin();
+
+    for (;;) {
+        if (xQueueReceive(telemetryQueue, &batch[batched], pdMS_TO_TICKS(STORE_DRAIN_INTERVAL)) == pdTRUE) {
+            if (batched == 0) batchStart = millis();
+            batched++;
         }
+
+        bool flush = batched == UPLINK_BATCH_SIZE ||
+                     (batched > 0 && (batch[batched - 1].leakMask || millis() - batchStart >= UPLINK_BATCH_WINDOW));
+        if (flush) {
+            if (!deliverTelemetry(batch, batched, false)) {
+                for (int i = 0; i < batched; i++) telemetryStore.push(batch[i]);
+            }
+            batched = 0;
+        }
+
+        static unsigned long lastDrain = 0;
+        if (wifiManager.isConnected() && !telemetryStore.isEmpty() &&
+            millis() - lastDrain >= STORE_DRAIN_INTERVAL) {
+            lastDrain = millis();
+            drainTelemetryStore();
+        }
+    }
+}
+
+// Replays up to STORE_DRAIN_BATCH stored summaries as one batch
+void drainTelemetryStore() {
+    static TelemetrySummary stored[STORE_DRAIN_BATCH];
+    uint32_t count = 0;
+    bool fromThisBoot;
+
+    while (count < STORE_DRAIN_BATCH && telemetryStore.peek(count, stored[count], fromThisBoot)) {
+        if (!fromThisBoot) stored[count].timestampUs = -1;
+        count++;
+    }
+    if (count > 0 && deliverTelemetry(stored, count, true)) {
+        telemetryStore.pop(count);
     }
 }
 
+bool deliverTelemetry(const TelemetrySummary summaries[], int count, bool replayed) {
+    if (TELEMETRY_OVER_MQTT) return mqttManager.publishTelemetry(summaries, count, replayed);
+    return wifiManager.isConnected() &&
+           httpClient.sendSensorBatch(deviceConfig.device_number, summaries, count, replayed);
+}
+
+// Reset button, checked only outside setup mode
+void uiTask(void* parameter) {
+    for (;;) {
+        if (webServer.getCurrentMode() != ServerMode::SETUP_MODE && buttonHandler.checkForReset()) {
+            Serial.println("Reset button pressed during operation. Resetting device...");
+            sensorManager.checkpointTotals();
+            prefsManager.clearAll();
+            ledController.blinkReset();
+            ledController.waitUntilIdle(3000);
+            ESP.restart();
+        }
+        vTaskDelay(pdMS_TO_TICKS(UI_TASK_PERIOD));
+    }
+}
+
+void checkForLeaks(uint8_t valveOpenMask) {
+    uint8_t cleared;
+    uint8_t started = leakDetector.update(flowSample, valveOpenMask, cleared);
+
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        uint8_t bit = 1 << i;
+        if (!((started | cleared) & bit)) continue;
+
+        if (started & bit) {
+            Serial.printf("🚨 Unexpected flow on sensor %d: %.2f L/min\n", i + 1, flowSample.rates[i]);
+        }
+
+        LeakEvent event = {(uint8_t)i, (started & bit) != 0, flowSample.rates[i], flowSample.totalLiters[i]};
+        xQueueSend(alarmQueue, &event, 0);
+    }
+}
 
 void performHeartbeat() {
     if (wifiManager.isConnected()) {
         Serial.println("Heartbeat: Device operational");
         Serial.printf("Free heap: %d bytes\n", ESP.getFreeHeap());
         Serial.println("WiFi RSSI: " + String(WiFi.RSSI()) + " dBm");
+        Serial.printf("Telemetry: %u sent, %u suppressed\n",
+                      reportFilter.getSentCount(), reportFilter.getSuppressedCount());
+        Serial.printf("MQTT: %u/%u connects succeeded, last %lu ms, avg %lu ms\n",
+                      mqttManager.getConnectSuccesses(), mqttManager.getConnectAttempts(),
+                      mqttManager.getLastConnectLatency(), mqttManager.getAverageConnectLatency());
+        TlsSessionClient& tls = mqttManager.getTlsClient();
+        Serial.printf("MQTT TLS: %u full handshakes (avg %lu ms), %u resumed (avg %lu ms)\n",
+                      tls.getFullHandshakes(), tls.getAverageFullHandshake(),
+                      tls.getResumedHandshakes(), tls.getAverageResumedHandshake());
+        Serial.printf("MQTT publish: %u sent, %u failed, %u dropped (queue full)\n",
+                      mqttManager.getPublishedCount(), mqttManager.getPublishFailures(),
+                      mqttManager.getQueueDrops());
+        UplinkSession& uplink = httpClient.getSession();
+        Serial.printf("Uplink: %u requests, %u failed, %u reconnects, latency last %lu / avg %lu / max %lu ms\n",
+                      uplink.getRequestCount(), uplink.getFailureCount(), uplink.getReconnectCount(),
+                      uplink.getLastLatency(), uplink.getAverageLatency(), uplink.getMaxLatency());
+        uint32_t samplesSent = httpClient.getSamplesSent();
+        if (samplesSent > 0) {
+            Serial.printf("Payload (%s): %u samples in %u requests, %u bytes/sample, %lu us encode/sample\n",
+                          httpClient.getContentType(), samplesSent, uplink.getRequestCount(),
+                          httpClient.getPayloadBytes() / samplesSent, httpClient.getEncodeMicros() / samplesSent);
+        }
+        ConnectivityProbe& probe = apiClient.getConnectivityProbe();
+        Serial.printf("Connectivity: %s, %u probes, %u failed, last %lu ms\n",
+                      ConnectivityProbe::describe(probe.getLastResult()), probe.getProbeCount(),
+                      probe.getFailureCount(), probe.getLastLatency());
+        Serial.printf("Requests: %u done, %u failed, %u expired, %u retries, %u rejected\n",
+                      requestQueue.getCompletedCount(), requestQueue.getFailedCount(),
+                      requestQueue.getExpiredCount(), requestQueue.getRetryCount(),
+                      requestQueue.getRejectedCount());
+        printHistogram("Request queue wait", requestQueue.getWaitHistogram());
+        printHistogram("Request latency", requestQueue.getLatencyHistogram());
+        Serial.printf("Store: %u pending, %u dropped, %u replayed\n", telemetryStore.depth(),
+                      telemetryStore.getDropCount(), telemetryStore.getReplayCount());
+        reportTaskStacks();
+
+        HeartbeatPayload heartbeat;
+        heartbeat.version = HEARTBEAT_VERSION;
+        heartbeat.resetReason = esp_reset_reason();
+        heartbeat.rssi = WiFi.RSSI();
+        heartbeat.valveMask = mqttManager.getValveOpenMask();
+        heartbeat.uptimeS = esp_timer_get_time() / 1000000;
+        heartbeat.minFreeHeap = ESP.getMinFreeHeap();
+        heartbeat.largestFreeBlock = ESP.getMaxAllocHeap();
+        heartbeat.maxLoopUs = maxControlLoopUs;
+        heartbeat.telemetryQueue = uxQueueMessagesWaiting(telemetryQueue);
+        heartbeat.alarmQueue = uxQueueMessagesWaiting(alarmQueue);
+        heartbeat.storeDepth = telemetryStore.depth();
+        heartbeat.mqttReconnects = mqttManager.getConnectSuccesses();
+        heartbeat.wifiReconnects = wifiManager.getConnectCount();
+        heartbeat.wifiFailures = wifiManager.getFailureCount();
+        heartbeat.publishDrops = mqttManager.getQueueDrops();
+        mqttManager.publishHeartbeat(heartbeat);
+        maxControlLoopUs = 0;
+    }
+}
 
-        // ✅ Publish heartbeat over MQTT
-        String topic = String(MQTT_BASE_TOPIC) + "/" +
-                       deviceConfig.customer_uid + "/" +
-                       deviceConfig.device_number + "/heartbeat";
+// Minimum free stack each task has ever had, in bytes
+void reportTaskStacks() {
+    TaskHandle_t tasks[] = {sensingTaskHandle, controlTaskHandle, webTaskHandle, uplinkTaskHandle,
+                            requestQueue.getTaskHandle(), uiTaskHandle};
+    for (TaskHandle_t task : tasks) {
+        if (task) {
+            Serial.printf("Stack %-8s: %u bytes free (min)\n", pcTaskGetName(task),
+                          (unsigned)uxTaskGetStackHighWaterMark(task));
+        }
+    }
+}
 
-        mqttManager.publishHeartbeat(topic);
+// "<label> (ms): <=10:3 <=50:12 ... >5000:0"
+void printHistogram(const char* label, const LatencyHistogram& histogram) {
+    Serial.printf("%s (ms):", label);
+    for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+        Serial.printf(" <=%u:%u", LatencyHistogram::BOUNDS[i], histogram.counts[i]);
     }
+    Serial.printf(" >%u:%u\n", LatencyHistogram::BOUNDS[LatencyHistogram::BUCKETS - 1],
+                  histogram.counts[LatencyHistogram::BUCKETS]);
 }
 
 void onCredentialsSaved(const String& ssid, const String& password, 
@@ -300,10 +602,19 @@ void performHardwareCheck() {
         status.flow_ok[i] = digitalRead(flowPins[i]) == HIGH || digitalRead(flowPins[i]) == LOW;
     }
 
-    // Check temperature sensor
+    // Check temperature probes (cached at boot, no conversion needed)
     status.temp_ok = sensorManager.isTemperatureSensorConnected();
+    status.temp_probe_count = sensorManager.getProbeCount();
+    for (int i = 0; i < status.temp_probe_count; i++) {
+        sensorManager.getProbeAddress(i, status.temp_probe_addr[i]);
+        status.temp_probe_ok[i] = sensorManager.isProbeHealthy(i);
+    }
 
     // Send to backend
-    httpClient.sendHardwareStatus(deviceConfig.device_number, status);
+    if (TELEMETRY_OVER_MQTT) {
+        mqttManager.publishHealth(status);
+    } else {
+        httpClient.sendHardwareStatus(deviceConfig.device_number, status);
+    }
 }
 
@@ -1,23 +1,19 @@
 #include "api_client.h"
 #include <ArduinoJson.h>
 
-APIClient::APIClient() {}
+APIClient::APIClient() : queue(nullptr) {}
 
-APIClient::~APIClient() {
-    http.end();
-}
+APIClient::~APIClient() {}
 
-void APIClient::setTimeout(int timeout) {
-    http.setTimeout(timeout);
+void APIClient::setRequestQueue(RequestQueue* requests) {
+    queue = requests;
 }
 
 bool APIClient::validateDevice(const String& customer_uid, const String& device_number, 
-                              const String& ssid, const String& password) {
+                              const String& ssid, const String& password,
+                              RequestCallback onComplete, void* context) {
     Serial.println("Validating device with server...");
-    
-    http.begin(API_ENDPOINT);
-    http.addHeader("Content-Type", "application/json");
-    setTimeout(HTTP_TIMEOUT);
+    if (!queue) return false;
 
     StaticJsonDocument<256> doc;
     doc["uid"] = customer_uid;
@@ -25,47 +21,25 @@ bool APIClient::validateDevice(const String& customer_uid, const String& device_
     doc["ssid"] = ssid;
     doc["wifi_password"] = password;
 
-    String jsonPayload;
-    serializeJson(doc, jsonPayload);
+    size_t length = serializeJson(doc, validationPayload, sizeof(validationPayload));
+    Serial.printf("Sending validation request: %s\n", validationPayload);
 
-    Serial.println("Sending validation request: " + jsonPayload);
+    OutboundRequest request = {API_ENDPOINT, "application/json", (const uint8_t*)validationPayload, length,
+                               REQUEST_HIGH, 3, VALIDATION_DEADLINE, onComplete, context};
+    return queue->submit(request);
+}
 
-    int httpCode = http.POST(jsonPayload);
+// Answered from the probe cache when possible; at first connect this is one
+// TCP connect (plus HEAD) to our own backend
+bool APIClient::hasInternetConnection() {
+    Serial.println("Checking backend connectivity...");
 
-    if (httpCode > 0) {
-        String response = http.getString();
-        Serial.print("HTTP Response code: ");
-        Serial.println(httpCode);
-        Serial.println("Response: " + response);
-        
-        http.end();
-        return (httpCode == 200);
-    } else {
-        Serial.print("HTTP Request failed, error: ");
-        Serial.println(http.errorToString(httpCode));
-    }
-    
-    http.end();
-    return false;
+    bool online = probe.check();
+    Serial.printf("Connectivity: %s (%lu ms)\n", ConnectivityProbe::describe(probe.getLastResult()),
+                  probe.getLastLatency());
+    return online;
 }
 
-bool APIClient::hasInternetConnection() {
-    Serial.println("Checking internet connectivity...");
-    
-    HTTPClient testHttp;
-    testHttp.begin(CONNECTIVITY_CHECK_URL);
-    testHttp.setTimeout(5000);
-    
-    int httpCode = testHttp.GET();
-    testHttp.end();
-    
-    if (httpCode > 0) {
-        Serial.print("Internet connectivity check - HTTP Response code: ");
-        Serial.println(httpCode);
-        return (httpCode == 200);
-    } else {
-        Serial.print("Internet connectivity check failed, error: ");
-        Serial.println(testHttp.errorToString(httpCode));
-        return false;
-    }
-}
\ No newline at end of file
+ConnectivityProbe& APIClient::getConnectivityProbe() {
+    return probe;
+}
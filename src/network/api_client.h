@@ -4,25 +4,31 @@
 #include <HTTPClient.h>
 #include <Arduino.h>
 #include "config.h"
+#include "request_queue.h"
+#include "connectivity_probe.h"
 
 // Forward declaration to avoid circular dependency
 class SensorManager;
 
 class APIClient {
 private:
-    HTTPClient http;
+    RequestQueue* queue;
+    ConnectivityProbe probe;
+    char validationPayload[256];  // kept until the validation request completes
 
 public:
     APIClient();
     ~APIClient();
-    
+    void setRequestQueue(RequestQueue* requests);
+
+    // Queued with retries; onComplete gets the HTTP status (200 = validated).
+    // Returns false if the request could not be queued.
     bool validateDevice(const String& customer_uid, const String& device_number, 
-                       const String& ssid, const String& password);
+                       const String& ssid, const String& password,
+                       RequestCallback onComplete, void* context);
     
     bool hasInternetConnection();
-    
-private:
-    void setTimeout(int timeout);
+    ConnectivityProbe& getConnectivityProbe();
 };
 
-#endif
\ No newline at end of file
+#endif
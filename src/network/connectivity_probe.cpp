@@ -0,0 +1,143 @@
+#include "connectivity_probe.h"
+#include <WiFi.h>
+
+static portMUX_TYPE probeLock = portMUX_INITIALIZER_UNLOCKED;
+
+ConnectivityProbe::ConnectivityProbe() : port(80), result(ProbeResult::UNKNOWN), checkedAt(0), lastLatency(0),
+                                         probeCount(0), failureCount(0), task(nullptr) {
+    parseBaseUrl(BACKEND_BASE_URL);
+}
+
+// "scheme://host[:port][/path]"; the port defaults to the scheme's
+void ConnectivityProbe::parseBaseUrl(const char* url) {
+    const char* start = strstr(url, "://");
+    if (start) {
+        if (strncmp(url, "https", 5) == 0) port = 443;
+        start += 3;
+    } else {
+        start = url;
+    }
+
+    size_t length = strcspn(start, ":/");
+    if (length >= sizeof(host)) length = sizeof(host) - 1;
+    memcpy(host, start, length);
+    host[length] = '\0';
+
+    if (start[length] == ':') port = atoi(start + length + 1);
+}
+
+bool ConnectivityProbe::check() {
+    if (!task) {
+        xTaskCreate(taskEntry, "probe", CONNECTIVITY_PROBE_STACK, this, CONNECTIVITY_PROBE_PRIORITY, &task);
+    }
+
+    portENTER_CRITICAL(&probeLock);
+    ProbeResult cached = result;
+    bool fresh = cached != ProbeResult::UNKNOWN && millis() - checkedAt < CONNECTIVITY_PROBE_TTL;
+    portEXIT_CRITICAL(&probeLock);
+    if (fresh) return cached == ProbeResult::OK;
+
+    unsigned long started = millis();
+    ProbeResult outcome = run();
+    store(outcome, millis() - started);
+    return outcome == ProbeResult::OK;
+}
+
+void ConnectivityProbe::refresh() {
+    if (task) xTaskNotifyGive(task);
+}
+
+// Re-probes at 3/4 of the TTL so check() rarely finds the cache expired
+void ConnectivityProbe::taskEntry(void* parameter) {
+    ConnectivityProbe* probe = (ConnectivityProbe*)parameter;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONNECTIVITY_PROBE_TTL * 3 / 4));
+        if (!WiFi.isConnected()) continue;
+
+        unsigned long started = millis();
+        ProbeResult outcome = probe->run();
+        probe->store(outcome, millis() - started);
+        if (outcome != ProbeResult::OK) {
+            Serial.printf("Connectivity probe: %s\n", describe(outcome));
+        }
+    }
+}
+
+ProbeResult ConnectivityProbe::run() {
+    if (!WiFi.isConnected()) return ProbeResult::NO_WIFI;
+
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip)) return ProbeResult::DNS_FAILED;
+
+    WiFiClient client;
+    if (!client.connect(ip, port, CONNECTIVITY_PROBE_TIMEOUT)) {
+        return ProbeResult::CONNECT_FAILED;
+    }
+    if (strlen(CONNECTIVITY_PROBE_PATH) == 0) {
+        client.stop();
+        return ProbeResult::OK;
+    }
+
+    // Any status line below 500 means the backend itself is answering
+    client.printf("HEAD %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                  CONNECTIVITY_PROBE_PATH, host);
+
+    // WiFiClient::setTimeout() takes seconds on core 2.x; poll against a ms deadline instead
+    char status[32];
+    size_t length = 0;
+    unsigned long deadline = millis() + CONNECTIVITY_PROBE_TIMEOUT;
+    while (length < sizeof(status) - 1 && (long)(millis() - deadline) < 0) {
+        if (!client.available()) {
+            if (!client.connected()) break;
+            delay(10);
+            continue;
+        }
+        char c = client.read();
+        if (c == '\n') break;
+        status[length++] = c;
+    }
+    status[length] = '\0';
+    client.stop();
+
+    const char* space = strchr(status, ' ');
+    int code = strncmp(status, "HTTP/", 5) == 0 && space ? atoi(space + 1) : 0;
+    return (code > 0 && code < 500) ? ProbeResult::OK : ProbeResult::HTTP_FAILED;
+}
+
+void ConnectivityProbe::store(ProbeResult outcome, unsigned long latency) {
+    portENTER_CRITICAL(&probeLock);
+    result = outcome;
+    checkedAt = millis();
+    lastLatency = latency;
+    probeCount++;
+    if (outcome != ProbeResult::OK) failureCount++;
+    portEXIT_CRITICAL(&probeLock);
+}
+
+ProbeResult ConnectivityProbe::getLastResult() {
+    return result;
+}
+
+unsigned long ConnectivityProbe::getLastLatency() {
+    return lastLatency;
+}
+
+uint32_t ConnectivityProbe::getProbeCount() {
+    return probeCount;
+}
+
+uint32_t ConnectivityProbe::getFailureCount() {
+    return failureCount;
+}
+
+const char* ConnectivityProbe::describe(ProbeResult result) {
+    switch (result) {
+        case ProbeResult::OK:             return "ok";
+        case ProbeResult::NO_WIFI:        return "no WiFi";
+        case ProbeResult::DNS_FAILED:     return "DNS failed";
+        case ProbeResult::CONNECT_FAILED: return "TCP connect failed";
+        case ProbeResult::HTTP_FAILED:    return "HTTP check failed";
+        default:                          return "unknown";
+    }
+}
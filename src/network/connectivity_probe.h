@@ -0,0 +1,53 @@
+#ifndef CONNECTIVITY_PROBE_H
+#define CONNECTIVITY_PROBE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+enum class ProbeResult : uint8_t {
+    UNKNOWN,
+    OK,
+    NO_WIFI,
+    DNS_FAILED,
+    CONNECT_FAILED,
+    HTTP_FAILED
+};
+
+// Layered reachability check of BACKEND_BASE_URL: DNS resolution, a TCP
+// connect and, if CONNECTIVITY_PROBE_PATH is set, a HEAD request; it stops
+// at the first layer that fails. Results are cached for CONNECTIVITY_PROBE_TTL
+// and a low-priority task refreshes them before they expire, so callers
+// usually get an answer without touching the network.
+class ConnectivityProbe {
+private:
+    char host[64];
+    uint16_t port;
+    ProbeResult result;
+    unsigned long checkedAt;
+    unsigned long lastLatency;
+    uint32_t probeCount;
+    uint32_t failureCount;
+    TaskHandle_t task;
+
+    static void taskEntry(void* parameter);
+    void parseBaseUrl(const char* url);
+    ProbeResult run();
+    void store(ProbeResult outcome, unsigned long latency);
+
+public:
+    ConnectivityProbe();
+
+    // Fresh cached result, or a synchronous probe when there is none;
+    // the first call also starts the background refresh
+    bool check();
+    void refresh();               // asks the background task to probe now
+
+    ProbeResult getLastResult();
+    unsigned long getLastLatency();  // ms for the last probe
+    uint32_t getProbeCount();
+    uint32_t getFailureCount();
+
+    static const char* describe(ProbeResult result);
+};
+
+#endif
@@ -1,52 +1,99 @@
 #include "http_client.h"
 #include <WiFi.h>
-#include <HTTPClient.h>
-#include <ArduinoJson.h>
-
-void HTTPClientManager::sendSensorData(const String& deviceNumber, float flows[], int count, float temperature) {
-    if (WiFi.status() == WL_CONNECTED) {
-        HTTPClient http;
-        http.begin("http://192.168.31.156:8000/api/device/data");
-        http.addHeader("Content-Type", "application/json");
-
-        String json = "{\"device_number\":\"" + deviceNumber + "\",\"flow_rates\":[";
-        for (int i = 0; i < count; i++) {
-            json += String(flows[i]);
-            if (i < count - 1) json += ",";
-        }
-        json += "],\"temperature\":" + String(temperature) + "}";
-
-        int httpCode = http.POST(json);
-        if (httpCode > 0) {
-            Serial.println("✅ Data sent to backend.");
-        } else {
-            Serial.printf("❌ Failed to send. Code: %d\n", httpCode);
-        }
-
-        http.end();
+#include <esp_timer.h>
+
+HTTPClientManager::HTTPClientManager()
+    : session(BACKEND_BASE_URL), queue(nullptr), healthPending(false),
+      encoder(&payloadEncoderFor(UPLINK_CONTENT_TYPE)), samplesSent(0), payloadBytes(0), encodeMicros(0) {}
+
+void HTTPClientManager::setRequestQueue(RequestQueue* requests) {
+    queue = requests;
+}
+
+UplinkSession& HTTPClientManager::getSession() {
+    return session;
+}
+
+bool HTTPClientManager::sendSensorData(const String& deviceNumber, const TelemetrySummary& summary, bool replayed) {
+    return sendSensorBatch(deviceNumber, &summary, 1, replayed);
+}
+
+bool HTTPClientManager::sendSensorBatch(const String& deviceNumber, const TelemetrySummary summaries[], int count,
+                                        bool replayed) {
+    if (WiFi.status() != WL_CONNECTED) return false;
+
+    unsigned long started = micros();
+    size_t length = encoder->encode(deviceNumber.c_str(), summaries, count, replayed, esp_timer_get_time(),
+                                    payloadBuffer, sizeof(payloadBuffer));
+    encodeMicros += micros() - started;
+    if (length == 0) {
+        Serial.printf("❌ Payload for %d sample(s) exceeds %u bytes\n", count, sizeof(payloadBuffer));
+        return false;
     }
+
+    PendingSend result = {xTaskGetCurrentTaskHandle(), 0};
+
+    OutboundRequest request = {SENSOR_DATA_PATH, encoder->contentType(), payloadBuffer, length,
+                               REQUEST_NORMAL, 2, UPLINK_TIMEOUT * 2, onSensorComplete, &result};
+    if (!queue || !queue->submit(request)) return false;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // every request completes, at worst by expiring
+    int httpCode = result.httpCode;
+
+    // Backend does not understand the binary format: stay on JSON from now on
+    if (httpCode == 415 && encoder != &payloadEncoderFor("application/json")) {
+        Serial.printf("Backend rejected %s, falling back to JSON\n", encoder->contentType());
+        encoder = &payloadEncoderFor("application/json");
+        return sendSensorBatch(deviceNumber, summaries, count, replayed);
+    }
+
+    // Only a 2xx means the backend kept the data; anything else goes to the store
+    if (httpCode >= 200 && httpCode < 300) {
+        samplesSent += count;
+        payloadBytes += length;
+        Serial.printf("✅ Data sent to backend (%d sample(s), %u bytes, %lu ms).\n",
+                      count, length, session.getLastLatency());
+        return true;
+    }
+    Serial.printf("❌ Failed to send. Code: %d\n", httpCode);
+    return false;
 }
 
-void HTTPClientManager::sendHardwareStatus(const String& deviceNumber, const HardwareStatus& status) {
-    StaticJsonDocument<512> doc;
-    doc["device_number"] = deviceNumber;
+uint32_t HTTPClientManager::getSamplesSent() {
+    return samplesSent;
+}
 
-    JsonArray valveArray = doc.createNestedArray("valves");
-    for (int i = 0; i < MAX_VALVES; i++) valveArray.add(status.valve_ok[i]);
+uint32_t HTTPClientManager::getPayloadBytes() {
+    return payloadBytes;
+}
 
-    JsonArray flowArray = doc.createNestedArray("flow_sensors");
-    for (int i = 0; i < MAX_FLOW_SENSORS; i++) flowArray.add(status.flow_ok[i]);
+unsigned long HTTPClientManager::getEncodeMicros() {
+    return encodeMicros;
+}
 
-    doc["temperature_sensor"] = status.temp_ok;
+const char* HTTPClientManager::getContentType() {
+    return encoder->contentType();
+}
+
+void HTTPClientManager::onSensorComplete(int httpCode, void* context) {
+    PendingSend* result = (PendingSend*)context;
+    result->httpCode = httpCode;
+    xTaskNotifyGive(result->waiter);
+}
 
-    String payload;
-    serializeJson(doc, payload);
+bool HTTPClientManager::sendHardwareStatus(const String& deviceNumber, const HardwareStatus& status) {
+    if (!queue || healthPending) return false;
 
-    HTTPClient http;
-    http.begin("http://192.168.31.156:8000/api/device/health-report");
-    http.addHeader("Content-Type", "application/json");
+    size_t length = encodeHardwareStatus(deviceNumber.c_str(), status, (uint8_t*)healthPayload,
+                                         sizeof(healthPayload));
+    if (length == 0) return false;
+
+    OutboundRequest request = {HEALTH_REPORT_PATH, "application/json", (const uint8_t*)healthPayload, length,
+                               REQUEST_LOW, 5, HEALTH_REPORT_DEADLINE, onHealthComplete, this};
+    healthPending = queue->submit(request);
+    return healthPending;
+}
 
-    int httpCode = http.POST(payload);
+void HTTPClientManager::onHealthComplete(int httpCode, void* context) {
     Serial.printf("Hardware status sent (code %d)\n", httpCode);
-    http.end();
+    ((HTTPClientManager*)context)->healthPending = false;
 }
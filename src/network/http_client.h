@@ -3,11 +3,55 @@
 
 #include <Arduino.h>
 #include "../../include/hardware_status.h"
+#include "../telemetry/stats_aggregator.h"
+#include "../telemetry/payload_encoder.h"
+#include "../telemetry/health_report.h"
+#include "uplink_session.h"
+#include "request_queue.h"
 
 class HTTPClientManager {
+private:
+    UplinkSession session;
+    RequestQueue* queue;
+
+    // Latest health report; a new one is skipped while it is still queued
+    char healthPayload[512];
+    volatile bool healthPending;
+
+    // Sensor payloads are encoded here; only the uplink task sends them
+    const PayloadEncoder* encoder;
+    uint8_t payloadBuffer[UPLINK_PAYLOAD_BUFFER];
+
+    // Wire usage, to compare batch sizes and encodings by bytes per sample
+    uint32_t samplesSent;
+    uint32_t payloadBytes;
+    unsigned long encodeMicros;
+
+    // Sensor sends block their caller until the request task reports back
+    struct PendingSend {
+        TaskHandle_t waiter;
+        int httpCode;
+    };
+    static void onSensorComplete(int httpCode, void* context);
+    static void onHealthComplete(int httpCode, void* context);
+
 public:
-    void sendHardwareStatus(const String& deviceNumber, const HardwareStatus& status);
-    void sendSensorData(const String& deviceNumber, float flows[], int count, float temperature);
+    HTTPClientManager();
+    void setRequestQueue(RequestQueue* requests);
+
+    // Queued and retried in the background; false if it could not be queued
+    bool sendHardwareStatus(const String& deviceNumber, const HardwareStatus& status);
+
+    // Run on the request task; the calling task waits for the outcome
+    bool sendSensorData(const String& deviceNumber, const TelemetrySummary& summary, bool replayed = false);
+    bool sendSensorBatch(const String& deviceNumber, const TelemetrySummary summaries[], int count,
+                         bool replayed = false);
+    UplinkSession& getSession();
+
+    uint32_t getSamplesSent();
+    uint32_t getPayloadBytes();
+    unsigned long getEncodeMicros();
+    const char* getContentType();
 };
 
 #endif
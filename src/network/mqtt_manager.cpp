@@ -1,10 +1,34 @@
 #include "mqtt_manager.h"
+#include "../../include/mqtt_ca_cert.h"
+#include <soc/gpio_reg.h>
+#include <esp_timer.h>
 
-MQTTManager::MQTTManager() : client(wifiClient) {}
+// Serialized TLS session; begin() runs before the control task starts
+static uint8_t sessionBuffer[MQTT_TLS_SESSION_MAX];
 
-void MQTTManager::begin(PreferencesManager* preferences) {
-    prefs = preferences;
+static portMUX_TYPE telemetryLock = portMUX_INITIALIZER_UNLOCKED;
+
+// FNV-1a; only tells one saved session from another
+static uint32_t sessionHash(const uint8_t* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    while (length--) hash = (hash ^ *data++) * 16777619u;
+    return hash;
+}
+
+MQTTManager::MQTTManager() : client(wifiClient), prefs(nullptr), sensorManager(nullptr),
+                             wasConnected(false), nextAttemptAt(0), backoff(MQTT_BACKOFF_INITIAL),
+                             connectAttempts(0), connectSuccesses(0),
+                             lastConnectLatency(0), totalConnectLatency(0),
+                             savedSessionHash(0), savedSessionAt(0), sessionSaved(false), publishQueue(nullptr),
+                             heldItem(nullptr), heldSize(0), publishedCount(0), publishFailures(0), queueDrops(0),
+                             telemetrySeq(0), awaitedSeq(0), telemetryPublished(false), telemetryWaiter(nullptr),
+                             pendingLeaks(0), pendingClears(0) {}
 
+void MQTTManager::setSensorManager(SensorManager* sensors) {
+    sensorManager = sensors;
+}
+
+void MQTTManager::beginValves() {
     // ✅ Properly copy GPIOs into valvePins[]
     const int pins[MAX_VALVES] = VALVE_PINS;
     memcpy(valvePins, pins, sizeof(pins));
@@ -15,9 +39,25 @@ void MQTTManager::begin(PreferencesManager* preferences) {
         digitalWrite(valvePins[i], HIGH);  // Start OFF
         Serial.printf("Valve %d initialized on GPIO %d\n", i + 1, valvePins[i]);
     }
+}
 
-    wifiClient.setInsecure(); // TLS for HiveMQ (dev mode)
+void MQTTManager::begin(PreferencesManager* preferences) {
+    prefs = preferences;
+
+    // Broker certificate is checked against the pinned root; the last TLS
+    // session is resumed on reconnect, across reboots when kept in NVS
+    wifiClient.setCACert(MQTT_CA_CERT, sizeof(MQTT_CA_CERT));
+    wifiClient.setIoTimeout(MQTT_SOCKET_TIMEOUT * 1000);
+    if (MQTT_TLS_SESSION_NVS) {
+        size_t length = prefs->loadTlsSession(sessionBuffer, sizeof(sessionBuffer));
+        if (length > 0 && !wifiClient.importSession(sessionBuffer, length)) prefs->clearTlsSession();
+        if (length > 0) savedSessionHash = sessionHash(sessionBuffer, length);
+    }
     client.setServer(MQTT_BROKER, MQTT_PORT);
+    client.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
+    client.setKeepAlive(MQTT_KEEPALIVE);
+    client.setBufferSize(UPLINK_PAYLOAD_BUFFER + 128); // payload plus topic and header
+    publishQueue = xRingbufferCreate(MQTT_PUBLISH_QUEUE_BYTES, RINGBUF_TYPE_NOSPLIT);
 
     client.setCallback([this](char* topic, byte* payload, unsigned int length) {
         this->handleMessage(topic, payload, length);
@@ -25,22 +65,74 @@ void MQTTManager::begin(PreferencesManager* preferences) {
 
     String uid = prefs->getCustomerUID();
     String deviceNumber = prefs->getDeviceNumber();
+    clientId = deviceNumber;
 
     deviceTopic = String(MQTT_BASE_TOPIC) + "/" + uid + "/" + deviceNumber + "/control";
+    alarmTopic = String(MQTT_BASE_TOPIC) + "/" + uid + "/" + deviceNumber + "/alarm";
+    telemetryTopic = String(MQTT_BASE_TOPIC) + "/" + uid + "/" + deviceNumber + "/telemetry";
+    healthTopic = String(MQTT_BASE_TOPIC) + "/" + uid + "/" + deviceNumber + "/health";
+    ackTopic = String(MQTT_BASE_TOPIC) + "/" + uid + "/" + deviceNumber + "/ack";
+    stateTopic = String(MQTT_BASE_TOPIC) + "/" + uid + "/" + deviceNumber + "/state";
+    statusTopic = String(MQTT_BASE_TOPIC) + "/" + uid + "/" + deviceNumber + "/status";
+    heartbeatTopic = String(MQTT_BASE_TOPIC) + "/" + uid + "/" + deviceNumber + "/heartbeat";
     Serial.println("Subscribing to MQTT topic: " + deviceTopic);
 }
 
-void MQTTManager::reconnect() {
-    while (!client.connected()) {
-        if (client.connect(prefs->getDeviceNumber().c_str(), MQTT_USER, MQTT_PASSWORD)) {
-            Serial.println("MQTT Connected");
-            subscribeToTopic();
-        } else {
-            Serial.print("MQTT Failed. State: ");
-            Serial.println(client.state());
-            delay(5000);
-        }
+// One connect attempt; on failure the next one is scheduled by scheduleRetry()
+bool MQTTManager::reconnect() {
+    connectAttempts++;
+    unsigned long started = millis();
+
+    // The broker flips /status to "offline" (retained) when the keepalive lapses
+    if (client.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD, statusTopic.c_str(), 1, true, "offline")) {
+        lastConnectLatency = millis() - started;
+        totalConnectLatency += lastConnectLatency;
+        connectSuccesses++;
+        backoff = MQTT_BACKOFF_INITIAL;
+        Serial.printf("MQTT Connected in %lu ms, TLS %s handshake %lu ms (%u/%u attempts succeeded)\n",
+                      lastConnectLatency, wifiClient.wasResumed() ? "resumed" : "full",
+                      wifiClient.getLastHandshakeTime(), connectSuccesses, connectAttempts);
+        if (!wifiClient.wasResumed()) persistTlsSession();
+        subscribeToTopic();
+        client.publish(statusTopic.c_str(), "online", true);
+        publishState(); // valves may have changed while offline (leak shutoff)
+        return true;
     }
+
+    Serial.print("MQTT Failed. State: ");
+    Serial.println(client.state());
+    scheduleRetry();
+    return false;
+}
+
+// Only after full handshakes, so resumed reconnects cost no flash writes.
+// A broker that never resumes makes every reconnect a full handshake, so the
+// write is also skipped when the session is unchanged and limited to one
+// per MQTT_TLS_SESSION_SAVE_INTERVAL.
+void MQTTManager::persistTlsSession() {
+    if (!MQTT_TLS_SESSION_NVS) return;
+    if (sessionSaved && millis() - savedSessionAt < MQTT_TLS_SESSION_SAVE_INTERVAL) return;
+
+    size_t length = wifiClient.exportSession(sessionBuffer, sizeof(sessionBuffer));
+    if (length == 0) return;
+
+    uint32_t hash = sessionHash(sessionBuffer, length);
+    if (hash == savedSessionHash) return;
+    if (prefs->saveTlsSession(sessionBuffer, length)) {
+        savedSessionHash = hash;
+        savedSessionAt = millis();
+        sessionSaved = true;
+    }
+}
+
+// Exponential backoff with equal jitter: wait in [backoff/2, backoff), so a
+// fleet that lost the broker at the same moment does not retry in lockstep
+void MQTTManager::scheduleRetry() {
+    unsigned long half = backoff / 2;
+    unsigned long wait = half + esp_random() % (half ? half : 1);
+    nextAttemptAt = millis() + wait;
+    backoff = min(backoff * 2, (unsigned long)MQTT_BACKOFF_MAX);
+    Serial.printf("MQTT retry in %lu ms\n", wait);
 }
 
 void MQTTManager::subscribeToTopic() {
@@ -48,38 +140,381 @@ void MQTTManager::subscribeToTopic() {
     client.subscribe(deviceTopic.c_str());
 }
 
+// Never blocks beyond a single connect attempt
 void MQTTManager::loop() {
-    if (!client.connected()) reconnect();
-    client.loop();
+    if (client.connected()) {
+        wasConnected = true;
+        client.loop();
+        flushPendingAlarms();
+        flushPublishQueue();
+        return;
+    }
+
+    if (wasConnected) {
+        // Connection just dropped: spread the first retry as well
+        wasConnected = false;
+        Serial.println("MQTT connection lost");
+        scheduleRetry();
+        return;
+    }
+
+    if ((long)(millis() - nextAttemptAt) >= 0) {
+        wasConnected = reconnect();
+    }
 }
 
+// The payload is parsed in place (ArduinoJson zero-copy mode), so strings in
+// the document point into PubSubClient's buffer and nothing is copied.
+// Every command is answered on the ack topic; "id" is echoed back verbatim.
 void MQTTManager::handleMessage(char* topic, byte* payload, unsigned int length) {
-    String msg;
-    for (int i = 0; i < length; i++) msg += (char)payload[i];
-    Serial.println("MQTT Message: " + msg);
+    int64_t receivedUs = esp_timer_get_time();
+    Serial.print("MQTT Message: ");
+    Serial.write(payload, length);
+    Serial.println();
 
-    StaticJsonDocument<256> doc;
-    if (deserializeJson(doc, msg)) {
+    StaticJsonDocument<512> doc;
+    if (deserializeJson(doc, (char*)payload, length)) {
         Serial.println("❌ JSON parse failed");
+        publishAck("null", false, -1);
         return;
     }
 
-    int valve = doc["valve_number"];
-    String action = doc["action"];
+    // The ack is published from the same buffer, so copy the id out first
+    char id[48] = "null";
+    if (!doc["id"].isNull() && measureJson(doc["id"]) < sizeof(id)) {
+        serializeJson(doc["id"], id, sizeof(id));
+    }
 
-    if (valve >= 1 && valve <= MAX_VALVES) {
-        int pin = valvePins[valve - 1];
-        digitalWrite(pin, (action == "on") ? LOW : HIGH);
-        Serial.printf("✅ Valve %d (GPIO %d) turned %s\n", valve, pin, action.c_str());
+    if (doc.containsKey("calibration")) {
+        publishAck(id, handleCalibration(doc["calibration"]), -1);
+        return;
+    }
+
+    // {"valves":[{"valve_number":1,"action":"on"},...]} or a single
+    // {"valve_number":1,"action":"on"}; all changes land in one GPIO update
+    uint8_t openMask = 0;
+    uint8_t changeMask = 0;
+    JsonArray valves = doc["valves"];
+    bool valid = valves.isNull() ? addValveCommand(doc.as<JsonObject>(), openMask, changeMask) : valves.size() > 0;
+    for (JsonObject command : valves) {
+        valid = valid && addValveCommand(command, openMask, changeMask);
+    }
+
+    if (!valid) {
+        Serial.println("⚠️ Invalid valve command received");
+        publishAck(id, false, -1);
+        return;
+    }
+    applyValves(openMask, changeMask);
+    int32_t latencyUs = esp_timer_get_time() - receivedUs;
+
+    publishAck(id, true, latencyUs);
+    publishState();
+    Serial.printf("✅ Valves updated in %d us, open mask now 0x%02X\n", (int)latencyUs, getValveOpenMask());
+}
+
+// {"id":<id>,"ok":true,"valves":<open mask>,"latency_us":<receive to GPIO>};
+// latency is left out when nothing was actuated
+void MQTTManager::publishAck(const char* id, bool ok, int32_t latencyUs) {
+    char payload[128];
+    int n = snprintf(payload, sizeof(payload), "{\"id\":%s,\"ok\":%s,\"valves\":%u", id,
+                     ok ? "true" : "false", getValveOpenMask());
+    if (latencyUs >= 0) n += snprintf(payload + n, sizeof(payload) - n, ",\"latency_us\":%d", (int)latencyUs);
+    snprintf(payload + n, sizeof(payload) - n, "}");
+    client.publish(ackTopic.c_str(), payload);
+}
+
+// Retained, so the control plane reads the current valve state on subscribe
+void MQTTManager::publishState() {
+    char payload[48];
+    snprintf(payload, sizeof(payload), "{\"valves\":%u}", getValveOpenMask());
+    client.publish(stateTopic.c_str(), payload, true);
+}
+
+bool MQTTManager::addValveCommand(JsonObject command, uint8_t& openMask, uint8_t& changeMask) {
+    int valve = command["valve_number"];
+    const char* action = command["action"];
+    if (valve < 1 || valve > MAX_VALVES || !action) return false;
+
+    uint8_t bit = 1 << (valve - 1);
+    if (strcmp(action, "on") == 0) {
+        openMask |= bit;
+    } else if (strcmp(action, "off") == 0) {
+        openMask &= ~bit;
     } else {
-        Serial.println("⚠️ Invalid valve_number received");
+        return false;
     }
+    changeMask |= bit;
+    return true;
 }
 
-void MQTTManager::publishHeartbeat(const String& topic) {
-    if (client.connected()) {
-        client.publish(topic.c_str(), "online", true);
+// Valves are active-low. Both set/clear registers are written back to back,
+// so every valve in a batch switches within the same few CPU cycles.
+void MQTTManager::applyValves(uint8_t openMask, uint8_t changeMask) {
+    uint32_t driveLow = 0;
+    uint32_t driveHigh = 0;
+    for (int i = 0; i < MAX_VALVES; i++) {
+        if (!(changeMask & (1 << i))) continue;
+        if (openMask & (1 << i)) {
+            driveLow |= 1UL << valvePins[i];
+        } else {
+            driveHigh |= 1UL << valvePins[i];
+        }
+    }
+    REG_WRITE(GPIO_OUT_W1TC_REG, driveLow);
+    REG_WRITE(GPIO_OUT_W1TS_REG, driveHigh);
+}
+
+// {"calibration":{"channel":1,"points":[[hz,lpm],...]}}; empty points restores the K-factor
+bool MQTTManager::handleCalibration(JsonObject cal) {
+    int channel = cal["channel"];
+    JsonArray points = cal["points"];
+
+    FlowCalibration curve;
+    curve.reset();
+    for (JsonVariant point : points) {
+        if (curve.count >= FLOW_CAL_MAX_POINTS) break;
+        curve.hz[curve.count] = point[0];
+        curve.lpm[curve.count] = point[1];
+        curve.count++;
+    }
+
+    if (sensorManager && sensorManager->setCalibration(channel - 1, curve)) {
+        Serial.printf("✅ Calibration applied to flow sensor %d\n", channel);
+        return true;
+    }
+    Serial.println("⚠️ Invalid calibration received");
+    return false;
+}
+
+// Diagnostics only; liveness is the retained /status and its last will
+void MQTTManager::publishHeartbeat(const HeartbeatPayload& heartbeat) {
+    if (client.connected() &&
+        client.publish(heartbeatTopic.c_str(), (const uint8_t*)&heartbeat, sizeof(heartbeat), false)) {
         Serial.println("📡 MQTT heartbeat published");
     }
 }
 
+void MQTTManager::publishLeakAlarm(const LeakEvent& event) {
+    uint8_t bit = 1 << event.channel;
+    pendingAlarms[event.channel][event.active] = event;
+    if (event.active) {
+        // Leaking again before the backend heard it had stopped
+        pendingClears &= ~bit;
+        pendingLeaks |= bit;
+    } else {
+        pendingClears |= bit;
+    }
+
+    if (!client.connected()) {
+        Serial.printf("⚠️ Leak alarm for sensor %d kept until MQTT reconnects\n", event.channel + 1);
+        return;
+    }
+    flushPendingAlarms();
+}
+
+// Sends what is pending, in order, until the broker refuses a message
+void MQTTManager::flushPendingAlarms() {
+    if (!(pendingLeaks | pendingClears) || !client.connected()) return;
+
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        uint8_t bit = 1 << i;
+        if (pendingLeaks & bit) {
+            if (!sendLeakAlarm(pendingAlarms[i][true])) return;
+            pendingLeaks &= ~bit;
+        }
+        if (pendingClears & bit) {
+            if (!sendLeakAlarm(pendingAlarms[i][false])) return;
+            pendingClears &= ~bit;
+        }
+    }
+}
+
+bool MQTTManager::sendLeakAlarm(const LeakEvent& event) {
+    char payload[128];
+    snprintf(payload, sizeof(payload),
+             "{\"type\":\"%s\",\"channel\":%d,\"flow_lpm\":%.2f,\"total_l\":%.3f}",
+             event.active ? "leak" : "leak_cleared", event.channel + 1, event.flowRate, event.totalLiters);
+
+    if (client.publish(alarmTopic.c_str(), payload)) {
+        Serial.printf("🚨 Leak alarm published: %s\n", payload);
+        return true;
+    }
+    Serial.printf("⚠️ Leak alarm not published, kept for retry: %s\n", payload);
+    return false;
+}
+
+bool MQTTManager::enqueue(MqttTopic topic, uint32_t seq, const uint8_t* payload, size_t length) {
+    void* item = nullptr;
+    PublishHeader header = {topic, seq};
+    if (!publishQueue || xRingbufferSendAcquire(publishQueue, &item, sizeof(header) + length, 0) != pdTRUE) {
+        queueDrops++;
+        return false;
+    }
+    memcpy(item, &header, sizeof(header));
+    memcpy((uint8_t*)item + sizeof(header), payload, length);
+    xRingbufferSendComplete(publishQueue, item);
+    return true;
+}
+
+// Bounded so a backlog never delays control messages for long; stops at the
+// first message the broker refuses
+void MQTTManager::flushPublishQueue() {
+    if (!publishQueue) return;
+
+    for (int i = 0; i < MQTT_PUBLISH_BURST; i++) {
+        uint8_t* item = heldItem;
+        size_t size = heldSize;
+        heldItem = nullptr;
+        if (!item) item = (uint8_t*)xRingbufferReceive(publishQueue, &size, 0);
+        if (!item) return;
+
+        if (!publishItem(item, size)) return;
+    }
+}
+
+// Returns false if the broker refused the message. A refused health report
+// is held for the next flush; a refused telemetry batch is reported back to
+// the uplink task, which keeps it in the store.
+bool MQTTManager::publishItem(uint8_t* item, size_t size) {
+    PublishHeader header;
+    memcpy(&header, item, sizeof(header));
+    const uint8_t* payload = item + sizeof(header);
+    size_t length = size - sizeof(header);
+
+    if (header.topic == MqttTopic::HEALTH) {
+        // Retained so a dashboard sees the last report right away
+        if (!client.publish(healthTopic.c_str(), payload, length, true)) {
+            publishFailures++;
+            heldItem = item;
+            heldSize = size;
+            return false;
+        }
+        publishedCount++;
+        vRingbufferReturnItem(publishQueue, item);
+        return true;
+    }
+
+    portENTER_CRITICAL(&telemetryLock);
+    bool awaited = header.seq == awaitedSeq;
+    portEXIT_CRITICAL(&telemetryLock);
+    if (!awaited) { // the uplink task gave up on it
+        vRingbufferReturnItem(publishQueue, item);
+        return true;
+    }
+
+    bool published = client.publish(telemetryTopic.c_str(), payload, length, false);
+    vRingbufferReturnItem(publishQueue, item);
+    if (published) {
+        publishedCount++;
+    } else {
+        publishFailures++;
+    }
+
+    TaskHandle_t waiter = nullptr;
+    portENTER_CRITICAL(&telemetryLock);
+    if (header.seq == awaitedSeq) {
+        telemetryPublished = published;
+        awaitedSeq = 0;
+        waiter = telemetryWaiter;
+    }
+    portEXIT_CRITICAL(&telemetryLock);
+    if (waiter) xTaskNotifyGive(waiter);
+    return published;
+}
+
+bool MQTTManager::publishTelemetry(const TelemetrySummary summaries[], int count, bool replayed) {
+    // Only the uplink task publishes telemetry
+    static uint8_t payload[UPLINK_PAYLOAD_BUFFER];
+
+    if (!wasConnected) return false; // the control task's view of the session
+
+    const PayloadEncoder& encoder = payloadEncoderFor(UPLINK_CONTENT_TYPE);
+    size_t length = encoder.encode(clientId.c_str(), summaries, count, replayed, esp_timer_get_time(),
+                                   payload, sizeof(payload));
+    if (length == 0) {
+        Serial.printf("❌ Payload for %d sample(s) exceeds %u bytes\n", count, sizeof(payload));
+        return false;
+    }
+
+    uint32_t seq = ++telemetrySeq;
+    if (seq == 0) seq = ++telemetrySeq;
+    ulTaskNotifyTake(pdTRUE, 0); // a late notification for an abandoned batch
+    portENTER_CRITICAL(&telemetryLock);
+    telemetryWaiter = xTaskGetCurrentTaskHandle();
+    telemetryPublished = false;
+    awaitedSeq = seq;
+    portEXIT_CRITICAL(&telemetryLock);
+
+    if (!enqueue(MqttTopic::TELEMETRY, seq, payload, length)) {
+        awaitedSeq = 0;
+        return false;
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_PUBLISH_WAIT));
+
+    // Handled means the control task got to it, even if just after the timeout
+    portENTER_CRITICAL(&telemetryLock);
+    bool published = awaitedSeq == 0 && telemetryPublished;
+    awaitedSeq = 0;
+    portEXIT_CRITICAL(&telemetryLock);
+    return published;
+}
+
+// Queued even while offline; it goes out once the session is up
+bool MQTTManager::publishHealth(const HardwareStatus& status) {
+    uint8_t payload[512];
+    size_t length = encodeHardwareStatus(clientId.c_str(), status, payload, sizeof(payload));
+    return length > 0 && enqueue(MqttTopic::HEALTH, 0, payload, length);
+}
+
+// Reads the driven output levels, not the pads
+uint8_t MQTTManager::getValveOpenMask() {
+    uint32_t levels = REG_READ(GPIO_OUT_REG);
+    uint8_t mask = 0;
+    for (int i = 0; i < MAX_VALVES; i++) {
+        if (!(levels & (1UL << valvePins[i]))) mask |= (1 << i);
+    }
+    return mask;
+}
+
+void MQTTManager::closeAllValves() {
+    applyValves(0, (1 << MAX_VALVES) - 1);
+    if (client.connected()) publishState();
+    Serial.println("🔒 All valves closed");
+}
+
+bool MQTTManager::isConnected() {
+    return client.connected();
+}
+
+uint32_t MQTTManager::getConnectAttempts() {
+    return connectAttempts;
+}
+
+uint32_t MQTTManager::getConnectSuccesses() {
+    return connectSuccesses;
+}
+
+unsigned long MQTTManager::getLastConnectLatency() {
+    return lastConnectLatency;
+}
+
+unsigned long MQTTManager::getAverageConnectLatency() {
+    return connectSuccesses ? totalConnectLatency / connectSuccesses : 0;
+}
+
+TlsSessionClient& MQTTManager::getTlsClient() {
+    return wifiClient;
+}
+
+uint32_t MQTTManager::getPublishedCount() {
+    return publishedCount;
+}
+
+uint32_t MQTTManager::getPublishFailures() {
+    return publishFailures;
+}
+
+uint32_t MQTTManager::getQueueDrops() {
+    return queueDrops;
+}
@@ -2,27 +2,122 @@
 #define MQTT_MANAGER_H
 
 #include <PubSubClient.h>
-#include <WiFiClientSecure.h>
 #include <ArduinoJson.h>
+#include <freertos/ringbuf.h>
 #include "../storage/preferences_manager.h"
+#include "../hardware/sensor_manager.h"
+#include "../hardware/leak_detector.h"
+#include "../telemetry/payload_encoder.h"
+#include "../telemetry/health_report.h"
+#include "tls_session_client.h"
+#include "../../include/heartbeat.h"
 #include "../config.h"
 
+enum class MqttTopic : uint8_t { TELEMETRY, HEALTH };
+
 class MQTTManager {
 private:
-    WiFiClientSecure wifiClient;
+    TlsSessionClient wifiClient;
     PubSubClient client;
+    String clientId;
     String deviceTopic;
+    String alarmTopic;
+    String telemetryTopic;
+    String healthTopic;
+    String ackTopic;
+    String stateTopic;
+    String statusTopic;
+    String heartbeatTopic;
     PreferencesManager* prefs;
+    SensorManager* sensorManager;
     int valvePins[MAX_VALVES];
 
+    // Reconnect scheduling and metrics
+    bool wasConnected;
+    unsigned long nextAttemptAt;
+    unsigned long backoff;
+    uint32_t connectAttempts;
+    uint32_t connectSuccesses;
+    unsigned long lastConnectLatency;
+    unsigned long totalConnectLatency;
+
+    // TLS session last written to NVS, to rate-limit and skip unchanged writes
+    uint32_t savedSessionHash;
+    unsigned long savedSessionAt;
+    bool sessionSaved;
+
+    // Outbound messages from other tasks; items are a PublishHeader plus the
+    // payload, written to the broker by loop() in the control task
+    struct PublishHeader {
+        MqttTopic topic;
+        uint32_t seq;       // telemetry: matched against awaitedSeq
+    };
+    RingbufHandle_t publishQueue;
+    uint8_t* heldItem;      // health report the broker refused; retried first
+    size_t heldSize;
+    uint32_t publishedCount;
+    uint32_t publishFailures;
+    uint32_t queueDrops;
+
+    // The uplink task waits for its telemetry batch to be published; a batch
+    // it stopped waiting for is skipped, as it already went to the store
+    uint32_t telemetrySeq;
+    volatile uint32_t awaitedSeq;   // 0 once the batch was handled or abandoned
+    volatile bool telemetryPublished;
+    TaskHandle_t telemetryWaiter;
+
+    // Leak edges the broker has not accepted yet, per channel; a leak edge is
+    // always sent before the matching leak_cleared
+    uint8_t pendingLeaks;
+    uint8_t pendingClears;
+    LeakEvent pendingAlarms[MAX_FLOW_SENSORS][2];  // [channel][active]
+
+    bool handleCalibration(JsonObject cal);
+    bool addValveCommand(JsonObject command, uint8_t& openMask, uint8_t& changeMask);
+    void applyValves(uint8_t openMask, uint8_t changeMask);
+    void publishAck(const char* id, bool ok, int32_t latencyUs);
+    void publishState();
+    void scheduleRetry();
+    void persistTlsSession();
+    bool enqueue(MqttTopic topic, uint32_t seq, const uint8_t* payload, size_t length);
+    void flushPublishQueue();
+    bool publishItem(uint8_t* item, size_t size);
+    bool sendLeakAlarm(const LeakEvent& event);
+    void flushPendingAlarms();
+
 public:
     MQTTManager();
+    // Drives every valve closed; done at boot, before sensing starts reading the mask
+    void beginValves();
     void begin(PreferencesManager* preferences);
+    void setSensorManager(SensorManager* sensors);
     void loop();
-    void reconnect();
+    bool reconnect();
     void subscribeToTopic();
     void handleMessage(char* topic, byte* payload, unsigned int length);
-    void publishHeartbeat(const String& topic);
+    void publishHeartbeat(const HeartbeatPayload& heartbeat);
+    // Kept and retried after reconnecting when the broker is unreachable
+    void publishLeakAlarm(const LeakEvent& event);
+
+    // Hands the batch to the control task and waits up to MQTT_PUBLISH_WAIT;
+    // true only once the broker socket accepted it
+    bool publishTelemetry(const TelemetrySummary summaries[], int count, bool replayed);
+    // Queued; kept and retried until the broker accepts it
+    bool publishHealth(const HardwareStatus& status);
+
+    // Valves are active-low: bit i set when valve i is open
+    uint8_t getValveOpenMask();
+    void closeAllValves();
+
+    bool isConnected();
+    uint32_t getConnectAttempts();
+    uint32_t getConnectSuccesses();
+    unsigned long getLastConnectLatency();     // ms spent in a successful connect()
+    unsigned long getAverageConnectLatency();
+    TlsSessionClient& getTlsClient();
+    uint32_t getPublishedCount();
+    uint32_t getPublishFailures();
+    uint32_t getQueueDrops();
 };
 
 #endif
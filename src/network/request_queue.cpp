@@ -0,0 +1,197 @@
+#include "request_queue.h"
+
+const uint16_t LatencyHistogram::BOUNDS[LatencyHistogram::BUCKETS] = {10, 50, 100, 250, 500, 1000, 2500, 5000};
+
+void LatencyHistogram::add(unsigned long ms) {
+    int i = 0;
+    while (i < BUCKETS && ms > BOUNDS[i]) i++;
+    counts[i]++;
+}
+
+RequestQueue::RequestQueue() : session(nullptr), lock(nullptr), task(nullptr), completedCount(0),
+                               failedCount(0), expiredCount(0), retryCount(0), rejectedCount(0) {
+    memset(entries, 0, sizeof(entries));
+    memset(&waitHistogram, 0, sizeof(waitHistogram));
+    memset(&latencyHistogram, 0, sizeof(latencyHistogram));
+}
+
+void RequestQueue::begin(UplinkSession* backend) {
+    if (task) return;
+
+    session = backend;
+    lock = xSemaphoreCreateMutex();
+    xTaskCreate(taskEntry, "requests", REQUEST_TASK_STACK, this, REQUEST_TASK_PRIORITY, &task);
+}
+
+bool RequestQueue::submit(const OutboundRequest& request) {
+    if (!task) return false;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int slot = -1;
+    for (int i = 0; i < REQUEST_QUEUE_LENGTH && slot < 0; i++) {
+        if (entries[i].state == EntryState::FREE) slot = i;
+    }
+    if (slot >= 0) {
+        Entry& entry = entries[slot];
+        entry.request = request;
+        entry.attempts = 0;
+        entry.enqueuedAt = millis();
+        entry.notBefore = entry.enqueuedAt;
+        entry.backoff = REQUEST_BACKOFF_INITIAL;
+        entry.state = EntryState::QUEUED;
+    } else {
+        rejectedCount++;
+    }
+    xSemaphoreGive(lock);
+
+    if (slot < 0) return false;
+    xTaskNotifyGive(task);
+    return true;
+}
+
+void RequestQueue::taskEntry(void* parameter) {
+    ((RequestQueue*)parameter)->run();
+}
+
+void RequestQueue::run() {
+    for (;;) {
+        unsigned long wait;
+        bool expired;
+        int index = takeNext(wait, expired);
+        if (index < 0) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+            continue;
+        }
+        if (expired) {
+            finish(index, REQUEST_EXPIRED);
+            continue;
+        }
+
+        // Only this task touches an ACTIVE entry
+        Entry& entry = entries[index];
+        unsigned long started = millis();
+        if (entry.attempts == 0) waitHistogram.add(started - entry.enqueuedAt);
+        entry.attempts++;
+
+        int httpCode = execute(entry.request);
+        unsigned long now = millis();
+        latencyHistogram.add(now - started);
+
+        bool retriable = httpCode <= 0 || httpCode == 429 || httpCode >= 500;
+        bool outOfTime = now - entry.enqueuedAt >= entry.request.deadlineMs;
+        if (!retriable || entry.attempts >= entry.request.maxAttempts || outOfTime) {
+            finish(index, httpCode);
+            continue;
+        }
+
+        // Equal jitter, as for the MQTT reconnects
+        unsigned long half = entry.backoff / 2;
+        unsigned long delayMs = half + esp_random() % (half ? half : 1);
+        entry.backoff = min(entry.backoff * 2, (unsigned long)REQUEST_BACKOFF_MAX);
+        retryCount++;
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        entry.notBefore = now + delayMs;
+        entry.state = EntryState::QUEUED;
+        xSemaphoreGive(lock);
+    }
+}
+
+// Picks the ready entry with the best priority (oldest first within one) and
+// marks it ACTIVE; returns -1 and the time until the next one is due otherwise.
+// Entries past their deadline are handed out first, flagged as expired.
+int RequestQueue::takeNext(unsigned long& wait, bool& expired) {
+    unsigned long now = millis();
+    int best = -1;
+    expired = false;
+    wait = 1000;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < REQUEST_QUEUE_LENGTH; i++) {
+        Entry& entry = entries[i];
+        if (entry.state != EntryState::QUEUED) continue;
+
+        if (now - entry.enqueuedAt >= entry.request.deadlineMs) {
+            best = i;
+            expired = true;
+            break;
+        }
+
+        long due = (long)(entry.notBefore - now);
+        if (due > 0) {
+            if ((unsigned long)due < wait) wait = due;
+            continue;
+        }
+
+        if (best < 0 || entry.request.priority < entries[best].request.priority ||
+            (entry.request.priority == entries[best].request.priority &&
+             (long)(entry.enqueuedAt - entries[best].enqueuedAt) < 0)) {
+            best = i;
+        }
+    }
+    if (best >= 0) entries[best].state = EntryState::ACTIVE;
+    xSemaphoreGive(lock);
+
+    return best;
+}
+
+int RequestQueue::execute(const OutboundRequest& request) {
+    if (strncmp(request.url, "http://", 7) != 0 && strncmp(request.url, "https://", 8) != 0) {
+        return session->post(request.url, request.contentType, request.body, request.length);
+    }
+
+    oneShot.begin(request.url);
+    oneShot.setTimeout(HTTP_TIMEOUT);
+    oneShot.addHeader("Content-Type", request.contentType);
+    int httpCode = oneShot.POST(const_cast<uint8_t*>(request.body), request.length);
+    oneShot.end();
+    return httpCode;
+}
+
+// The slot is released before the callback, so it may submit a follow-up
+void RequestQueue::finish(int index, int httpCode) {
+    RequestCallback onComplete = entries[index].request.onComplete;
+    void* context = entries[index].request.context;
+
+    completedCount++;
+    if (httpCode == REQUEST_EXPIRED) expiredCount++;
+    if (httpCode < 200 || httpCode >= 300) failedCount++;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    entries[index].state = EntryState::FREE;
+    xSemaphoreGive(lock);
+
+    if (onComplete) onComplete(httpCode, context);
+}
+
+const LatencyHistogram& RequestQueue::getWaitHistogram() {
+    return waitHistogram;
+}
+
+const LatencyHistogram& RequestQueue::getLatencyHistogram() {
+    return latencyHistogram;
+}
+
+uint32_t RequestQueue::getCompletedCount() {
+    return completedCount;
+}
+
+uint32_t RequestQueue::getFailedCount() {
+    return failedCount;
+}
+
+uint32_t RequestQueue::getExpiredCount() {
+    return expiredCount;
+}
+
+uint32_t RequestQueue::getRetryCount() {
+    return retryCount;
+}
+
+uint32_t RequestQueue::getRejectedCount() {
+    return rejectedCount;
+}
+
+TaskHandle_t RequestQueue::getTaskHandle() {
+    return task;
+}
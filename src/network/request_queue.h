@@ -0,0 +1,100 @@
+#ifndef REQUEST_QUEUE_H
+#define REQUEST_QUEUE_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include "config.h"
+#include "uplink_session.h"
+
+enum RequestPriority : uint8_t {
+    REQUEST_HIGH = 0,    // onboarding
+    REQUEST_NORMAL = 1,  // telemetry
+    REQUEST_LOW = 2      // health reports
+};
+
+// Passed to onComplete when the deadline ran out before a usable answer
+#define REQUEST_EXPIRED -100
+
+// httpCode: HTTP status, a negative HTTPClient error, or REQUEST_EXPIRED
+typedef void (*RequestCallback)(int httpCode, void* context);
+
+// One outbound POST. The body is not copied: the caller keeps it alive and
+// unchanged until onComplete has been called.
+struct OutboundRequest {
+    const char* url;           // path on the backend session, or an absolute http(s):// URL
+    const char* contentType;
+    const uint8_t* body;
+    size_t length;
+    RequestPriority priority;
+    uint8_t maxAttempts;
+    uint32_t deadlineMs;       // from submission; no new attempt starts after it
+    RequestCallback onComplete;
+    void* context;
+};
+
+// Counts per latency bucket; bucket i holds values <= BOUNDS[i] ms, the last one the rest
+struct LatencyHistogram {
+    static const int BUCKETS = 8;
+    static const uint16_t BOUNDS[BUCKETS];
+    uint32_t counts[BUCKETS + 1];
+
+    void add(unsigned long ms);
+};
+
+// All HTTP traffic runs on one task, so a slow backend only delays other
+// requests, never the caller. Requests wait in a small bounded pool and are
+// served by priority, then submission order. Transport errors, 429 and 5xx
+// are retried with jittered exponential backoff until maxAttempts or the
+// deadline; every request ends with exactly one onComplete call, made from
+// the request task.
+class RequestQueue {
+private:
+    enum class EntryState : uint8_t { FREE, QUEUED, ACTIVE };
+
+    struct Entry {
+        OutboundRequest request;
+        EntryState state;
+        uint8_t attempts;
+        unsigned long enqueuedAt;
+        unsigned long notBefore;
+        unsigned long backoff;
+    };
+
+    Entry entries[REQUEST_QUEUE_LENGTH];
+    UplinkSession* session;
+    HTTPClient oneShot;         // absolute URLs outside the backend session
+    SemaphoreHandle_t lock;
+    TaskHandle_t task;
+
+    LatencyHistogram waitHistogram;     // submission to first attempt
+    LatencyHistogram latencyHistogram;  // per attempt
+    uint32_t completedCount;
+    uint32_t failedCount;
+    uint32_t expiredCount;
+    uint32_t retryCount;
+    uint32_t rejectedCount;
+
+    static void taskEntry(void* parameter);
+    void run();
+    int takeNext(unsigned long& wait, bool& expired);
+    int execute(const OutboundRequest& request);
+    void finish(int index, int httpCode);
+
+public:
+    RequestQueue();
+    void begin(UplinkSession* backend);
+
+    // False when the queue is full; onComplete is then never called
+    bool submit(const OutboundRequest& request);
+
+    const LatencyHistogram& getWaitHistogram();
+    const LatencyHistogram& getLatencyHistogram();
+    uint32_t getCompletedCount();
+    uint32_t getFailedCount();     // completed without a 2xx, expired included
+    uint32_t getExpiredCount();
+    uint32_t getRetryCount();
+    uint32_t getRejectedCount();   // submit() on a full queue
+    TaskHandle_t getTaskHandle();
+};
+
+#endif
@@ -0,0 +1,339 @@
+#include "tls_session_client.h"
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include <errno.h>
+
+// lwip maps the BSD names to macros, which clash with the Client methods
+#undef connect
+#undef write
+#undef read
+
+TlsSessionClient::TlsSessionClient()
+    : caCert(nullptr), caCertLength(0), timeoutMs(5000), configured(false), sslActive(false),
+      hasSession(false), certificateVerified(false), peeked(-1), lastResumed(false), lastHandshake(0),
+      fullCount(0), resumedCount(0), fullTotal(0), resumedTotal(0) {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&ca);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_session_init(&session);
+    mbedtls_net_init(&net);
+}
+
+TlsSessionClient::~TlsSessionClient() {
+    stop();
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_x509_crt_free(&ca);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+}
+
+void TlsSessionClient::setCACert(const char* pem, size_t length) {
+    caCert = pem;
+    caCertLength = length;
+}
+
+void TlsSessionClient::setIoTimeout(uint32_t ms) {
+    timeoutMs = ms;
+}
+
+// Shared by every connection; done on the first connect
+bool TlsSessionClient::configure() {
+    if (configured) return true;
+
+    static const char personalization[] = "greenmesh-mqtt";
+    int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                    (const unsigned char*)personalization, sizeof(personalization) - 1);
+    if (ret == 0 && caCert) {
+        ret = mbedtls_x509_crt_parse(&ca, (const unsigned char*)caCert, caCertLength);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret != 0) {
+        Serial.printf("TLS setup failed: -0x%04X\n", -ret);
+        return false;
+    }
+
+    if (caCert) {
+        mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_ca_chain(&conf, &ca, nullptr);
+    } else {
+        mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_NONE);
+        Serial.println("⚠️ TLS without a CA: server is not verified");
+    }
+    mbedtls_ssl_conf_verify(&conf, onVerify, this);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+    configured = true;
+    return true;
+}
+
+// Called for each certificate of the chain; a resumed handshake has no chain
+int TlsSessionClient::onVerify(void* ctx, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+    ((TlsSessionClient*)ctx)->certificateVerified = true;
+    return 0;
+}
+
+bool TlsSessionClient::openSocket(const char* host, uint16_t port) {
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip)) return false;
+
+    int fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) return false;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = (uint32_t)ip;
+
+    // Non-blocking from here on: connect is bounded by select(), and
+    // mbedtls sees WANT_READ/WANT_WRITE instead of stalling the task
+    lwip_fcntl(fd, F_SETFL, lwip_fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int res = lwip_connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    if (res < 0 && errno != EINPROGRESS) {
+        lwip_close(fd);
+        return false;
+    }
+
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(fd, &writable);
+    struct timeval tv = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+    int err = 0;
+    socklen_t errLen = sizeof(err);
+    if (lwip_select(fd + 1, nullptr, &writable, nullptr, &tv) <= 0 ||
+        lwip_getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0 || err != 0) {
+        lwip_close(fd);
+        return false;
+    }
+
+    int one = 1;
+    lwip_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    net.fd = fd;
+    return true;
+}
+
+bool TlsSessionClient::handshake() {
+    unsigned long started = millis();
+    int ret;
+
+    while ((ret = mbedtls_ssl_handshake(&ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            Serial.printf("TLS handshake failed: -0x%04X (verify flags 0x%x)\n", -ret,
+                          (unsigned)mbedtls_ssl_get_verify_result(&ssl));
+            return false;
+        }
+        if (millis() - started > timeoutMs) {
+            Serial.println("TLS handshake timed out");
+            return false;
+        }
+        delay(2);
+    }
+    return true;
+}
+
+int TlsSessionClient::connect(const char* host, uint16_t port) {
+    stop();
+    if (!configure() || !openSocket(host, port)) return 0;
+
+    mbedtls_ssl_init(&ssl);
+    sslActive = true;
+    if (mbedtls_ssl_setup(&ssl, &conf) != 0 || mbedtls_ssl_set_hostname(&ssl, host) != 0) {
+        stop();
+        return 0;
+    }
+    mbedtls_ssl_set_bio(&ssl, &net, mbedtls_net_send, mbedtls_net_recv, nullptr);
+
+    bool resuming = hasSession && mbedtls_ssl_set_session(&ssl, &session) == 0;
+    certificateVerified = false;
+    unsigned long started = millis();
+
+    if (!handshake()) {
+        // The server may have forgotten the session; start clean next time
+        if (resuming) clearSession();
+        stop();
+        return 0;
+    }
+
+    // The server only skips the certificate when it accepted the session
+    lastHandshake = millis() - started;
+    lastResumed = resuming && !certificateVerified;
+    if (lastResumed) {
+        resumedCount++;
+        resumedTotal += lastHandshake;
+    } else {
+        fullCount++;
+        fullTotal += lastHandshake;
+    }
+
+    // Keep the newest session (and ticket, if the server issued one)
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_session_init(&session);
+    hasSession = mbedtls_ssl_get_session(&ssl, &session) == 0;
+    return 1;
+}
+
+int TlsSessionClient::connect(IPAddress ip, uint16_t port) {
+    String host = ip.toString();
+    return connect(host.c_str(), port);
+}
+
+int TlsSessionClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    timeoutMs = timeout;
+    return connect(ip, port);
+}
+
+int TlsSessionClient::connect(const char* host, uint16_t port, int32_t timeout) {
+    timeoutMs = timeout;
+    return connect(host, port);
+}
+
+size_t TlsSessionClient::write(uint8_t b) {
+    return write(&b, 1);
+}
+
+size_t TlsSessionClient::write(const uint8_t* buf, size_t size) {
+    if (!sslActive) return 0;
+
+    size_t sent = 0;
+    unsigned long started = millis();
+    while (sent < size) {
+        int ret = mbedtls_ssl_write(&ssl, buf + sent, size - sent);
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+        if (ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ) {
+            stop();
+            break;
+        }
+        if (millis() - started > timeoutMs) break;
+        delay(1);
+    }
+    return sent;
+}
+
+// Processes whatever arrived on the socket without blocking
+int TlsSessionClient::available() {
+    if (!sslActive) return 0;
+
+    int ret = mbedtls_ssl_read(&ssl, nullptr, 0);
+    if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        stop();
+        return peeked >= 0 ? 1 : 0;
+    }
+    return mbedtls_ssl_get_bytes_avail(&ssl) + (peeked >= 0 ? 1 : 0);
+}
+
+int TlsSessionClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int TlsSessionClient::read(uint8_t* buf, size_t size) {
+    if (size == 0) return 0;
+
+    int offset = 0;
+    if (peeked >= 0) {
+        buf[0] = peeked;
+        peeked = -1;
+        offset = 1;
+    }
+    if (!sslActive || offset == (int)size) return offset ? offset : -1;
+
+    int ret = mbedtls_ssl_read(&ssl, buf + offset, size - offset);
+    if (ret > 0) return offset + ret;
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) stop();  // 0 = peer closed
+    return offset ? offset : -1;
+}
+
+int TlsSessionClient::peek() {
+    if (peeked < 0 && sslActive) {
+        uint8_t b;
+        int ret = mbedtls_ssl_read(&ssl, &b, 1);
+        if (ret == 1) {
+            peeked = b;
+        } else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            stop();
+        }
+    }
+    return peeked;
+}
+
+void TlsSessionClient::flush() {}
+
+void TlsSessionClient::stop() {
+    if (sslActive) {
+        mbedtls_ssl_close_notify(&ssl);
+        mbedtls_ssl_free(&ssl);
+        sslActive = false;
+    }
+    mbedtls_net_free(&net);
+    peeked = -1;
+}
+
+uint8_t TlsSessionClient::connected() {
+    if (!sslActive) return peeked >= 0;
+    if (peeked >= 0 || mbedtls_ssl_get_bytes_avail(&ssl) > 0) return 1;
+
+    uint8_t probe;
+    int res = lwip_recv(net.fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (res > 0 || (res < 0 && (errno == EWOULDBLOCK || errno == EAGAIN))) return 1;
+
+    stop();  // 0 = orderly close, anything else = socket error
+    return 0;
+}
+
+TlsSessionClient::operator bool() {
+    return connected();
+}
+
+void TlsSessionClient::clearSession() {
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_session_init(&session);
+    hasSession = false;
+}
+
+size_t TlsSessionClient::exportSession(uint8_t* buffer, size_t capacity) {
+    size_t length = 0;
+    if (!hasSession || mbedtls_ssl_session_save(&session, buffer, capacity, &length) != 0) return 0;
+    return length;
+}
+
+bool TlsSessionClient::importSession(const uint8_t* buffer, size_t length) {
+    clearSession();
+    hasSession = mbedtls_ssl_session_load(&session, buffer, length) == 0;
+    if (!hasSession) clearSession();
+    return hasSession;
+}
+
+bool TlsSessionClient::wasResumed() {
+    return lastResumed;
+}
+
+unsigned long TlsSessionClient::getLastHandshakeTime() {
+    return lastHandshake;
+}
+
+uint32_t TlsSessionClient::getFullHandshakes() {
+    return fullCount;
+}
+
+uint32_t TlsSessionClient::getResumedHandshakes() {
+    return resumedCount;
+}
+
+unsigned long TlsSessionClient::getAverageFullHandshake() {
+    return fullCount ? fullTotal / fullCount : 0;
+}
+
+unsigned long TlsSessionClient::getAverageResumedHandshake() {
+    return resumedCount ? resumedTotal / resumedCount : 0;
+}
@@ -0,0 +1,86 @@
+#ifndef TLS_SESSION_CLIENT_H
+#define TLS_SESSION_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+
+// TLS client on top of mbedtls that verifies the server against a pinned CA
+// and keeps the last session (ID or ticket) to resume the next handshake.
+// WiFiClientSecure starts from scratch on every connect; after a WiFi blip a
+// resumed handshake skips the certificate exchange and the ECDHE math.
+// The session can be exported/imported so it survives a reboot.
+class TlsSessionClient : public Client {
+private:
+    const char* caCert;
+    size_t caCertLength;
+    uint32_t timeoutMs;
+
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_x509_crt ca;
+    mbedtls_ssl_config conf;
+    mbedtls_ssl_context ssl;
+    mbedtls_net_context net;
+    mbedtls_ssl_session session;
+    bool configured;
+    bool sslActive;
+    bool hasSession;
+    bool certificateVerified;  // set by the verify callback, i.e. only on full handshakes
+    int peeked;
+
+    // Handshake metrics (ms)
+    bool lastResumed;
+    unsigned long lastHandshake;
+    uint32_t fullCount;
+    uint32_t resumedCount;
+    unsigned long fullTotal;
+    unsigned long resumedTotal;
+
+    bool configure();
+    bool openSocket(const char* host, uint16_t port);
+    bool handshake();
+    static int onVerify(void* ctx, mbedtls_x509_crt* crt, int depth, uint32_t* flags);
+
+public:
+    TlsSessionClient();
+    ~TlsSessionClient();
+
+    // PEM, NUL-terminated; length includes the terminator
+    void setCACert(const char* pem, size_t length);
+    // Bounds the TCP connect, the handshake and each write
+    void setIoTimeout(uint32_t ms);
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int connect(const char* host, uint16_t port, int32_t timeout);
+    size_t write(uint8_t b);
+    size_t write(const uint8_t* buf, size_t size);
+    int available();
+    int read();
+    int read(uint8_t* buf, size_t size);
+    int peek();
+    void flush();
+    void stop();
+    uint8_t connected();
+    operator bool();
+
+    // Session cache; export works once a handshake has completed
+    void clearSession();
+    size_t exportSession(uint8_t* buffer, size_t capacity);
+    bool importSession(const uint8_t* buffer, size_t length);
+
+    bool wasResumed();                      // last successful handshake
+    unsigned long getLastHandshakeTime();
+    uint32_t getFullHandshakes();
+    uint32_t getResumedHandshakes();
+    unsigned long getAverageFullHandshake();
+    unsigned long getAverageResumedHandshake();
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "uplink_session.h"
+
+UplinkSession::UplinkSession(const char* baseUrl) : baseUrl(baseUrl), lock(xSemaphoreCreateMutex()),
+                                                    requestCount(0), failureCount(0), reconnectCount(0),
+                                                    lastLatency(0), maxLatency(0), totalLatency(0) {
+    http.setReuse(true);
+    http.setTimeout(UPLINK_TIMEOUT);
+    http.setConnectTimeout(UPLINK_TIMEOUT);
+}
+
+int UplinkSession::post(const char* path, const char* contentType, const uint8_t* body, size_t length) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    unsigned long started = millis();
+    String url = baseUrl + path;
+    int httpCode = -1;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = tcp.connected();
+
+        http.begin(tcp, url);
+        http.addHeader("Content-Type", contentType);
+        httpCode = http.POST(const_cast<uint8_t*>(body), length);
+        if (httpCode > 0) http.getString(); // drain the body so the socket can be reused
+        http.end(); // keeps the connection open while the server allows it
+
+        // A kept-alive socket the server already closed fails on first use
+        if (httpCode > 0 || !reused) break;
+        tcp.stop();
+        reconnectCount++;
+    }
+
+    lastLatency = millis() - started;
+    totalLatency += lastLatency;
+    if (lastLatency > maxLatency) maxLatency = lastLatency;
+    requestCount++;
+    if (httpCode <= 0) failureCount++;
+
+    xSemaphoreGive(lock);
+    return httpCode;
+}
+
+int UplinkSession::post(const char* path, const String& json) {
+    return post(path, "application/json", (const uint8_t*)json.c_str(), json.length());
+}
+
+uint32_t UplinkSession::getRequestCount() {
+    return requestCount;
+}
+
+uint32_t UplinkSession::getFailureCount() {
+    return failureCount;
+}
+
+uint32_t UplinkSession::getReconnectCount() {
+    return reconnectCount;
+}
+
+unsigned long UplinkSession::getLastLatency() {
+    return lastLatency;
+}
+
+unsigned long UplinkSession::getMaxLatency() {
+    return maxLatency;
+}
+
+unsigned long UplinkSession::getAverageLatency() {
+    return requestCount ? totalLatency / requestCount : 0;
+}
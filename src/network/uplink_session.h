@@ -0,0 +1,44 @@
+#ifndef UPLINK_SESSION_H
+#define UPLINK_SESSION_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <HTTPClient.h>
+#include "config.h"
+
+// Long-lived HTTP session to the backend. One TCP connection is kept open
+// with HTTP keep-alive and reused across requests; if the server closed it,
+// the request is retried once on a fresh connection. Safe to share between
+// tasks.
+class UplinkSession {
+private:
+    String baseUrl;
+    WiFiClient tcp;
+    HTTPClient http;
+    SemaphoreHandle_t lock;
+
+    // Per-request latency (ms)
+    uint32_t requestCount;
+    uint32_t failureCount;
+    uint32_t reconnectCount;
+    unsigned long lastLatency;
+    unsigned long maxLatency;
+    unsigned long totalLatency;
+
+public:
+    // Fixed for the session's lifetime; ConnectivityProbe checks the same BACKEND_BASE_URL
+    UplinkSession(const char* baseUrl);
+
+    // Returns the HTTP status code, or a negative HTTPClient error
+    int post(const char* path, const char* contentType, const uint8_t* body, size_t length);
+    int post(const char* path, const String& json);
+
+    uint32_t getRequestCount();
+    uint32_t getFailureCount();
+    uint32_t getReconnectCount();
+    unsigned long getLastLatency();
+    unsigned long getMaxLatency();
+    unsigned long getAverageLatency();
+};
+
+#endif
@@ -1,30 +1,164 @@
 #include "wifi_manager.h"
 
-WiFiManager::WiFiManager() : currentState(WiFiState::DISCONNECTED) {}
+WiFiManager::WiFiManager() : currentState(WiFiState::DISCONNECTED), enabled(false), everConnected(false),
+                             prefs(nullptr), hasFastConnect(false), fastAttempt(false),
+                             gotIPEvent(false), disconnectedEvent(false), attempts(0),
+                             attemptStarted(0), retryAt(0), backoff(WIFI_BACKOFF_INITIAL),
+                             connectCount(0), failureCount(0), disconnectCount(0),
+                             lastConnectTime(0), totalConnectTime(0) {}
+
+void WiFiManager::setPreferencesManager(PreferencesManager* preferences) {
+    prefs = preferences;
+}
+
+void WiFiManager::begin(const String& ssid, const String& password) {
+    this->ssid = ssid;
+    this->password = password;
+    hasFastConnect = WIFI_FAST_CONNECT && prefs && prefs->loadFastConnect(fastConnect);
+
+    // Events only raise flags; all state changes happen in loop()
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+        this->onEvent(event, info);
+    });
 
-WiFiState WiFiManager::connectToWiFi(const String& ssid, const String& password) {
-    currentState = WiFiState::CONNECTING;
-    
     WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid.c_str(), password.c_str());
-    Serial.println("Connecting to WiFi...");
-
-    int retry = 0;
-    while (WiFi.status() != WL_CONNECTED && retry < WIFI_RETRY_COUNT) {
-        delay(500);
-        Serial.print(".");
-        retry++;
+    WiFi.setAutoReconnect(false); // retries are paced by our backoff instead
+
+    enabled = true;
+    attempts = 0;
+    backoff = WIFI_BACKOFF_INITIAL;
+    startAttempt();
+}
+
+void WiFiManager::onEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            gotIPEvent = true;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            disconnectedEvent = true;
+            break;
+        default:
+            break;
     }
+}
+
+void WiFiManager::startAttempt() {
+    gotIPEvent = false;
+    disconnectedEvent = false;
+    attemptStarted = millis();
+    currentState = WiFiState::CONNECTING;
+
+    // Fast path only as the first try of a connect sequence
+    fastAttempt = hasFastConnect && attempts == 0;
 
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("\nWiFi Connected.");
-        currentState = WiFiState::CONNECTED;
-        return WiFiState::CONNECTED;
+    if (fastAttempt && WIFI_STATIC_IP) {
+        WiFi.config(IPAddress(fastConnect.ip), IPAddress(fastConnect.gateway),
+                    IPAddress(fastConnect.subnet), IPAddress(fastConnect.dns));
     } else {
-        Serial.println("WiFi Connection Failed.");
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // DHCP
+    }
+
+    if (fastAttempt) {
+        Serial.printf("Connecting to WiFi (fast: channel %d%s)...\n",
+                      fastConnect.channel, WIFI_STATIC_IP ? ", static IP" : "");
+        WiFi.begin(ssid.c_str(), password.c_str(), fastConnect.channel, fastConnect.bssid);
+    } else {
+        Serial.printf("Connecting to WiFi (attempt %d, full scan)...\n", attempts + 1);
+        WiFi.begin(ssid.c_str(), password.c_str());
+    }
+}
+
+// Caches the association and lease; written only when something changed
+void WiFiManager::rememberConnection() {
+    if (!prefs) return;
+
+    WiFiFastConnect info;
+    memset(&info, 0, sizeof(info)); // padding too, so memcmp below is meaningful
+    memcpy(info.bssid, WiFi.BSSID(), sizeof(info.bssid));
+    info.channel = WiFi.channel();
+    info.ip = WiFi.localIP();
+    info.gateway = WiFi.gatewayIP();
+    info.subnet = WiFi.subnetMask();
+    info.dns = WiFi.dnsIP();
+
+    if (hasFastConnect && memcmp(&info, &fastConnect, sizeof(info)) == 0) return;
+
+    if (prefs->saveFastConnect(info)) {
+        fastConnect = info;
+        hasFastConnect = true;
+    }
+}
+
+void WiFiManager::attemptFailed(const char* reason) {
+    failureCount++;
+    attempts++;
+    WiFi.disconnect();
+
+    if (fastAttempt) {
+        // Stale BSSID/channel: fall back to a full scan right away
+        Serial.printf("WiFi fast connect failed (%s), scanning\n", reason);
+        hasFastConnect = false;
+        attempts--;
+        retryAt = millis();
+        currentState = WiFiState::DISCONNECTED;
+        return;
+    }
+
+    if (!everConnected && attempts >= WIFI_BOOT_ATTEMPTS) {
+        Serial.printf("WiFi Connection Failed (%s).\n", reason);
         currentState = WiFiState::FAILED;
-        return WiFiState::FAILED;
+        enabled = false;
+        return;
     }
+
+    Serial.printf("WiFi attempt failed (%s), retrying in %lu ms\n", reason, backoff);
+    retryAt = millis() + backoff;
+    backoff = min(backoff * 2, (unsigned long)WIFI_BACKOFF_MAX);
+    currentState = WiFiState::DISCONNECTED;
+}
+
+WiFiState WiFiManager::loop() {
+    if (!enabled) return currentState;
+
+    switch (currentState) {
+        case WiFiState::CONNECTING:
+            if (gotIPEvent) {
+                lastConnectTime = millis() - attemptStarted;
+                totalConnectTime += lastConnectTime;
+                connectCount++;
+                everConnected = true;
+                attempts = 0;
+                backoff = WIFI_BACKOFF_INITIAL;
+                disconnectedEvent = false;
+                currentState = WiFiState::CONNECTED;
+                Serial.printf("WiFi Connected in %lu ms (time to IP, %s).\n", lastConnectTime,
+                              fastAttempt ? (WIFI_STATIC_IP ? "fast + static IP" : "fast") : "full scan");
+                rememberConnection();
+            } else if (disconnectedEvent) {
+                attemptFailed("rejected");
+            } else if (millis() - attemptStarted > WIFI_CONNECT_TIMEOUT) {
+                attemptFailed("timeout");
+            }
+            break;
+
+        case WiFiState::CONNECTED:
+            if (disconnectedEvent) {
+                disconnectCount++;
+                Serial.println("WiFi disconnected.");
+                retryAt = millis() + backoff;
+                currentState = WiFiState::DISCONNECTED;
+            }
+            break;
+
+        case WiFiState::DISCONNECTED:
+            if ((long)(millis() - retryAt) >= 0) startAttempt();
+            break;
+
+        case WiFiState::FAILED:
+            break;
+    }
+    return currentState;
 }
 
 bool WiFiManager::isConnected() {
@@ -36,6 +170,7 @@ String WiFiManager::getLocalIP() {
 }
 
 void WiFiManager::disconnect() {
+    enabled = false;
     WiFi.disconnect();
     currentState = WiFiState::DISCONNECTED;
 }
@@ -44,7 +179,28 @@ WiFiState WiFiManager::getCurrentState() {
     return currentState;
 }
 
+uint32_t WiFiManager::getConnectCount() {
+    return connectCount;
+}
+
+uint32_t WiFiManager::getFailureCount() {
+    return failureCount;
+}
+
+uint32_t WiFiManager::getDisconnectCount() {
+    return disconnectCount;
+}
+
+unsigned long WiFiManager::getLastConnectTime() {
+    return lastConnectTime;
+}
+
+unsigned long WiFiManager::getAverageConnectTime() {
+    return connectCount ? totalConnectTime / connectCount : 0;
+}
+
 bool WiFiManager::startAPMode() {
+    enabled = false;
     WiFi.disconnect();
     delay(100);
     
@@ -59,4 +215,4 @@ void WiFiManager::stopAPMode() {
 
 String WiFiManager::getAPIP() {
     return WiFi.softAPIP().toString();
-}
\ No newline at end of file
+}
@@ -4,30 +4,73 @@
 #include <WiFi.h>
 #include <Arduino.h>
 #include "config.h"
+#include "../storage/preferences_manager.h"
 
 enum class WiFiState {
-    DISCONNECTED,
+    DISCONNECTED,   // waiting for the next attempt (backoff)
     CONNECTING,
     CONNECTED,
-    FAILED
+    FAILED          // gave up; only reached before the first successful connect
 };
 
+// Event-driven station connection. begin() returns immediately; loop() drives
+// attempt timeouts and exponential backoff from the ESP32 WiFi events, so a
+// flaky AP never blocks the caller.
+// The first attempt of each connect goes straight to the cached BSSID/channel
+// (and optionally the cached lease as a static IP); a full scan with DHCP is
+// only used when that fails.
 class WiFiManager {
 private:
-    WiFiState currentState;
-    
+    volatile WiFiState currentState;
+    String ssid;
+    String password;
+    bool enabled;
+    bool everConnected;
+    PreferencesManager* prefs;
+    WiFiFastConnect fastConnect;
+    bool hasFastConnect;
+    bool fastAttempt;
+
+    volatile bool gotIPEvent;
+    volatile bool disconnectedEvent;
+
+    int attempts;
+    unsigned long attemptStarted;
+    unsigned long retryAt;
+    unsigned long backoff;
+
+    // Connection metrics
+    uint32_t connectCount;
+    uint32_t failureCount;
+    uint32_t disconnectCount;
+    unsigned long lastConnectTime;
+    unsigned long totalConnectTime;
+
+    void onEvent(arduino_event_id_t event, arduino_event_info_t info);
+    void startAttempt();
+    void attemptFailed(const char* reason);
+    void rememberConnection();
+
 public:
     WiFiManager();
-    WiFiState connectToWiFi(const String& ssid, const String& password);
+    void setPreferencesManager(PreferencesManager* preferences);
+    void begin(const String& ssid, const String& password);
+    WiFiState loop();
     bool isConnected();
     String getLocalIP();
     void disconnect();
     WiFiState getCurrentState();
-    
+
+    uint32_t getConnectCount();
+    uint32_t getFailureCount();
+    uint32_t getDisconnectCount();
+    unsigned long getLastConnectTime();     // ms from attempt start to IP
+    unsigned long getAverageConnectTime();
+
     // AP Mode functions
     bool startAPMode();
     void stopAPMode();
     String getAPIP();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,93 @@
+#include "littlefs_segments.h"
+
+LittleFsSegments::LittleFsSegments(const char* directory) : directory(directory) {}
+
+bool LittleFsSegments::begin() {
+    return LittleFS.exists(directory) || LittleFS.mkdir(directory);
+}
+
+void LittleFsSegments::segmentPath(uint32_t id, char* path, size_t capacity) {
+    snprintf(path, capacity, "%s/%u", directory, (unsigned)id);
+}
+
+void LittleFsSegments::metaPath(char* path, size_t capacity) {
+    snprintf(path, capacity, "%s/meta", directory);
+}
+
+int LittleFsSegments::list(uint32_t ids[], int capacity) {
+    File dir = LittleFS.open(directory);
+    if (!dir || !dir.isDirectory()) return 0;
+
+    int count = 0;
+    for (File file = dir.openNextFile(); file && count < capacity; file = dir.openNextFile()) {
+        const char* name = strrchr(file.name(), '/');
+        name = name ? name + 1 : file.name();
+
+        // Numeric names only; skips the meta file
+        char* end;
+        unsigned long id = strtoul(name, &end, 10);
+        if (end != name && *end == '\0') ids[count++] = id;
+    }
+    return count;
+}
+
+size_t LittleFsSegments::size(uint32_t id) {
+    char path[32];
+    segmentPath(id, path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    return file ? file.size() : 0;
+}
+
+bool LittleFsSegments::read(uint32_t id, size_t offset, uint8_t* head, size_t headLength,
+                            uint8_t* body, size_t bodyLength) {
+    char path[32];
+    segmentPath(id, path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    if (!file) return false;
+
+    bool success = file.seek(offset) && file.read(head, headLength) == headLength &&
+                   file.read(body, bodyLength) == bodyLength;
+    file.close();
+    return success;
+}
+
+bool LittleFsSegments::append(uint32_t id, const uint8_t* head, size_t headLength,
+                              const uint8_t* body, size_t bodyLength) {
+    char path[32];
+    segmentPath(id, path, sizeof(path));
+    File file = LittleFS.open(path, "a");
+    if (!file) return false;
+
+    bool success = file.write(head, headLength) == headLength && file.write(body, bodyLength) == bodyLength;
+    file.close();
+    return success;
+}
+
+bool LittleFsSegments::remove(uint32_t id) {
+    char path[32];
+    segmentPath(id, path, sizeof(path));
+    return LittleFS.remove(path);
+}
+
+bool LittleFsSegments::readMeta(uint8_t slot, uint8_t* buffer, size_t length) {
+    char path[32];
+    metaPath(path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    if (!file) return false;
+
+    bool success = file.seek(slot * length) && file.read(buffer, length) == length;
+    file.close();
+    return success;
+}
+
+// The meta file is a few bytes and stays inline in LittleFS metadata
+bool LittleFsSegments::writeMeta(uint8_t slot, const uint8_t* data, size_t length) {
+    char path[32];
+    metaPath(path, sizeof(path));
+    File file = LittleFS.open(path, LittleFS.exists(path) ? "r+" : "w");
+    if (!file) return false;
+
+    bool success = file.seek(slot * length) && file.write(data, length) == length;
+    file.close();
+    return success;
+}
@@ -0,0 +1,33 @@
+#ifndef LITTLEFS_SEGMENTS_H
+#define LITTLEFS_SEGMENTS_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "record_log.h"
+
+// RecordLog segments as files <directory>/<id>, meta slots in <directory>/meta.
+// Every append opens the file in append mode and closes it, which commits
+// the record; LittleFS only rewrites the file's last block for that.
+class LittleFsSegments : public SegmentStorage {
+private:
+    const char* directory;
+
+    void segmentPath(uint32_t id, char* path, size_t capacity);
+    void metaPath(char* path, size_t capacity);
+
+public:
+    explicit LittleFsSegments(const char* directory);
+    bool begin();   // LittleFS must be mounted
+
+    int list(uint32_t ids[], int capacity) override;
+    size_t size(uint32_t id) override;
+    bool read(uint32_t id, size_t offset, uint8_t* head, size_t headLength,
+              uint8_t* body, size_t bodyLength) override;
+    bool append(uint32_t id, const uint8_t* head, size_t headLength,
+                const uint8_t* body, size_t bodyLength) override;
+    bool remove(uint32_t id) override;
+    bool readMeta(uint8_t slot, uint8_t* buffer, size_t length) override;
+    bool writeMeta(uint8_t slot, const uint8_t* data, size_t length) override;
+};
+
+#endif
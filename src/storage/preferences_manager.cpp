@@ -2,10 +2,26 @@
 #include "mbedtls/aes.h" // Optional, only needed for real encryption
 
 const char* PreferencesManager::NAMESPACE = "wifi";
+const char* PreferencesManager::FLOW_NAMESPACE = "flow";
 
-PreferencesManager::PreferencesManager() {}
+// Holds the manager's mutex for the rest of the scope
+class PreferencesLock {
+private:
+    SemaphoreHandle_t mutex;
+
+public:
+    explicit PreferencesLock(SemaphoreHandle_t mutex) : mutex(mutex) {
+        xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    }
+    ~PreferencesLock() {
+        xSemaphoreGiveRecursive(mutex);
+    }
+};
+
+PreferencesManager::PreferencesManager() : lock(xSemaphoreCreateRecursiveMutex()) {}
 
 bool PreferencesManager::loadConfig(DeviceConfig& config) {
+    PreferencesLock guard(lock);
     preferences.begin(NAMESPACE, true);
 
     config.ssid = preferences.getString("ssid", "");
@@ -23,6 +39,7 @@ bool PreferencesManager::loadConfig(DeviceConfig& config) {
 }
 
 bool PreferencesManager::saveConfig(const DeviceConfig& config) {
+    PreferencesLock guard(lock);
     Serial.println("Opening preferences for saving config...");
     if (!preferences.begin(NAMESPACE, false)) {
         Serial.println("Failed to begin preferences in saveConfig()");
@@ -47,6 +64,7 @@ bool PreferencesManager::saveConfig(const DeviceConfig& config) {
 
 bool PreferencesManager::saveCredentials(const String& ssid, const String& password,
                                          const String& customer_uid, const String& device_number) {
+    PreferencesLock guard(lock);
     if (ssid.length() < 1 || ssid.length() > 32 ||
         password.length() < 8 || password.length() > 63 ||
         customer_uid.isEmpty() || device_number.isEmpty()) {
@@ -66,10 +84,12 @@ bool PreferencesManager::saveCredentials(const String& ssid, const String& passw
     config.isOnboarded = false;
     config.isFirstBoot = true;
 
+    clearFastConnect(); // cached BSSID/lease belong to the old network
     return saveConfig(config);
 }
 
 bool PreferencesManager::markAsOnboarded() {
+    PreferencesLock guard(lock);
     preferences.begin(NAMESPACE, false);
     bool success = preferences.putBool("onboarded", true);
     preferences.end();
@@ -77,6 +97,7 @@ bool PreferencesManager::markAsOnboarded() {
 }
 
 bool PreferencesManager::markFirstBootComplete() {
+    PreferencesLock guard(lock);
     preferences.begin(NAMESPACE, false);
     bool success = preferences.putBool("first_boot", false);
     preferences.end();
@@ -84,6 +105,7 @@ bool PreferencesManager::markFirstBootComplete() {
 }
 
 bool PreferencesManager::isFirstBoot() {
+    PreferencesLock guard(lock);
     preferences.begin(NAMESPACE, true);
     bool firstBoot = preferences.getBool("first_boot", true);
     preferences.end();
@@ -91,7 +113,11 @@ bool PreferencesManager::isFirstBoot() {
 }
 
 void PreferencesManager::clearAll() {
-    preferences.begin(NAMESPACE, false);
+    PreferencesLock guard(lock);
+    if (!preferences.begin(NAMESPACE, false)) {
+        Serial.println("Failed to begin preferences in clearAll()");
+        return;
+    }
     preferences.clear();
     preferences.end();
 }
@@ -114,6 +140,7 @@ String PreferencesManager::decryptString(const String& input) {
 }
 
 String PreferencesManager::getDeviceNumber() {
+    PreferencesLock guard(lock);
     preferences.begin(NAMESPACE, true);
     String deviceNumber = preferences.getString("device_number", "");
     preferences.end();
@@ -121,9 +148,111 @@ String PreferencesManager::getDeviceNumber() {
 }
 
 String PreferencesManager::getCustomerUID() {
+    PreferencesLock guard(lock);
     preferences.begin(NAMESPACE, true);
     String customerUID = preferences.getString("customer_uid", "");
     preferences.end();
     return customerUID;
 }
 
+bool PreferencesManager::loadFastConnect(WiFiFastConnect& info) {
+    PreferencesLock guard(lock);
+    preferences.begin(NAMESPACE, true);
+    bool found = preferences.getBytes("fast_connect", &info, sizeof(info)) == sizeof(info);
+    preferences.end();
+    return found && info.channel > 0;
+}
+
+bool PreferencesManager::saveFastConnect(const WiFiFastConnect& info) {
+    PreferencesLock guard(lock);
+    if (!preferences.begin(NAMESPACE, false)) {
+        Serial.println("Failed to begin preferences in saveFastConnect()");
+        return false;
+    }
+    bool success = preferences.putBytes("fast_connect", &info, sizeof(info)) == sizeof(info);
+    preferences.end();
+    return success;
+}
+
+void PreferencesManager::clearFastConnect() {
+    PreferencesLock guard(lock);
+    preferences.begin(NAMESPACE, false);
+    preferences.remove("fast_connect");
+    preferences.end();
+}
+
+size_t PreferencesManager::loadTlsSession(uint8_t* buffer, size_t capacity) {
+    PreferencesLock guard(lock);
+    preferences.begin(NAMESPACE, true);
+    size_t length = preferences.getBytesLength("tls_session");
+    if (length > capacity) length = 0;
+    if (length > 0) length = preferences.getBytes("tls_session", buffer, length);
+    preferences.end();
+    return length;
+}
+
+bool PreferencesManager::saveTlsSession(const uint8_t* buffer, size_t length) {
+    PreferencesLock guard(lock);
+    if (!preferences.begin(NAMESPACE, false)) {
+        Serial.println("Failed to begin preferences in saveTlsSession()");
+        return false;
+    }
+    bool success = preferences.putBytes("tls_session", buffer, length) == length;
+    preferences.end();
+    return success;
+}
+
+void PreferencesManager::clearTlsSession() {
+    PreferencesLock guard(lock);
+    preferences.begin(NAMESPACE, false);
+    preferences.remove("tls_session");
+    preferences.end();
+}
+
+bool PreferencesManager::loadFlowCalibration(int channel, FlowCalibration& cal) {
+    PreferencesLock guard(lock);
+    String key = "cal" + String(channel);
+    cal.reset();
+
+    preferences.begin(FLOW_NAMESPACE, true);
+    bool found = preferences.getBytes(key.c_str(), &cal, sizeof(cal)) == sizeof(cal);
+    preferences.end();
+
+    if (!found || !cal.isValid()) {
+        cal.reset();
+        return false;
+    }
+    return true;
+}
+
+bool PreferencesManager::saveFlowCalibration(int channel, const FlowCalibration& cal) {
+    PreferencesLock guard(lock);
+    String key = "cal" + String(channel);
+
+    if (!preferences.begin(FLOW_NAMESPACE, false)) {
+        Serial.println("Failed to begin preferences in saveFlowCalibration()");
+        return false;
+    }
+    bool success = preferences.putBytes(key.c_str(), &cal, sizeof(cal)) == sizeof(cal);
+    preferences.end();
+    return success;
+}
+
+bool PreferencesManager::loadFlowTotals(double liters[], int count) {
+    PreferencesLock guard(lock);
+    preferences.begin(FLOW_NAMESPACE, true);
+    bool found = preferences.getBytes("totals", liters, count * sizeof(double)) == count * sizeof(double);
+    preferences.end();
+    return found;
+}
+
+bool PreferencesManager::saveFlowTotals(const double liters[], int count) {
+    PreferencesLock guard(lock);
+    if (!preferences.begin(FLOW_NAMESPACE, false)) {
+        Serial.println("Failed to begin preferences in saveFlowTotals()");
+        return false;
+    }
+    bool success = preferences.putBytes("totals", liters, count * sizeof(double)) == count * sizeof(double);
+    preferences.end();
+    return success;
+}
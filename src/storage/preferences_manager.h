@@ -3,6 +3,7 @@
 
 #include <Preferences.h>
 #include <Arduino.h>
+#include "../hardware/flow_calibration.h"
 
 struct DeviceConfig {
     String ssid;
@@ -13,10 +14,26 @@ struct DeviceConfig {
     bool isFirstBoot;
 };
 
+// Last successful association and DHCP lease, used to skip the scan (and
+// optionally DHCP) on the next connect
+struct WiFiFastConnect {
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+
+// Shared by the sensing (totalizer), control (calibration, TLS session),
+// web (WiFi cache) and ui (reset) tasks. Preferences holds a single open
+// namespace, so every method runs under one recursive mutex.
 class PreferencesManager {
 private:
     Preferences preferences;
+    SemaphoreHandle_t lock;
     static const char* NAMESPACE;
+    static const char* FLOW_NAMESPACE;  // survives clearAll()
     static String encryptString(const String& input);
     static String decryptString(const String& input);
 
@@ -34,6 +51,21 @@ public:
     String getDeviceNumber();
     String getCustomerUID();
 
+    bool loadFastConnect(WiFiFastConnect& info);
+    bool saveFastConnect(const WiFiFastConnect& info);
+    void clearFastConnect();
+
+    // Serialized MQTT TLS session, for resumption after a reboot
+    size_t loadTlsSession(uint8_t* buffer, size_t capacity);
+    bool saveTlsSession(const uint8_t* buffer, size_t length);
+    void clearTlsSession();
+
+    // Flow metering data
+    bool loadFlowCalibration(int channel, FlowCalibration& cal);
+    bool saveFlowCalibration(int channel, const FlowCalibration& cal);
+    bool loadFlowTotals(double liters[], int count);
+    bool saveFlowTotals(const double liters[], int count);
+
 };
 
 
@@ -0,0 +1,225 @@
+#include "record_log.h"
+#include <string.h>
+
+static const uint32_t META_MAGIC = 0x47544D32;
+
+// CRC-32 (IEEE, reflected); bitwise, as records are small and written rarely
+static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length) {
+    crc = ~crc;
+    while (length--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+RecordLog::RecordLog(SegmentStorage* storage, size_t payloadSize, uint32_t magic,
+                     uint32_t capacity, uint32_t segmentRecords)
+    : storage(storage), payloadSize(payloadSize), magic(magic), segmentRecords(segmentRecords),
+      scratch(new uint8_t[payloadSize]), segmentCount(0), nextSegmentId(0), head(0), tail(0),
+      metaSlot(0), dropCount(0) {
+    maxSegments = capacity / segmentRecords;
+    if (maxSegments < 1) maxSegments = 1;
+    if (maxSegments > MAX_SEGMENTS) maxSegments = MAX_SEGMENTS;
+}
+
+RecordLog::~RecordLog() {
+    delete[] scratch;
+}
+
+uint32_t RecordLog::recordCrc(uint32_t seq, const uint8_t* payload, size_t length) {
+    uint32_t crc = crc32(0, (const uint8_t*)&seq, sizeof(seq));
+    return crc32(crc, payload, length);
+}
+
+bool RecordLog::readRecord(const Segment& segment, uint32_t index, RecordHeader& header, uint8_t* payload) {
+    size_t offset = (size_t)index * (sizeof(RecordHeader) + payloadSize);
+    if (!storage->read(segment.id, offset, (uint8_t*)&header, sizeof(header), payload, payloadSize)) return false;
+
+    return header.magic == magic && header.seq == segment.firstSeq + index &&
+           header.crc == recordCrc(header.seq, payload, payloadSize);
+}
+
+// Counts the complete records of one segment. Appends are atomic on
+// LittleFS, but a partial or corrupt last record is dropped all the same.
+bool RecordLog::recoverSegment(uint32_t id, Segment& segment) {
+    const size_t recordSize = sizeof(RecordHeader) + payloadSize;
+    size_t bytes = storage->size(id);
+
+    RecordHeader header;
+    segment.id = id;
+    segment.count = bytes / recordSize;
+    segment.sealed = bytes % recordSize != 0;
+    if (segment.count == 0 ||
+        !storage->read(id, 0, (uint8_t*)&header, sizeof(header), scratch, payloadSize) ||
+        header.magic != magic) {
+        return false;
+    }
+    segment.firstSeq = header.seq;
+
+    while (segment.count > 0 && !readRecord(segment, segment.count - 1, header, scratch)) {
+        segment.count--;
+        segment.sealed = true;
+    }
+    return segment.count > 0;
+}
+
+void RecordLog::begin() {
+    uint32_t ids[MAX_SEGMENTS * 2];
+    int found = storage->list(ids, MAX_SEGMENTS * 2);
+
+    // Ids only grow, so sorting them restores the write order
+    for (int i = 1; i < found; i++) {
+        uint32_t id = ids[i];
+        int j = i;
+        for (; j > 0 && ids[j - 1] > id; j--) ids[j] = ids[j - 1];
+        ids[j] = id;
+    }
+
+    segmentCount = 0;
+    nextSegmentId = found > 0 ? ids[found - 1] + 1 : 0;
+    for (int i = 0; i < found; i++) {
+        Segment segment;
+        if (!recoverSegment(ids[i], segment)) {
+            storage->remove(ids[i]);
+            continue;
+        }
+        if (segmentCount == (int)maxSegments) removeSegment(0); // capacity was lowered
+        segments[segmentCount++] = segment;
+    }
+
+    // Only the newest segment may take more records
+    for (int i = 0; i + 1 < segmentCount; i++) segments[i].sealed = true;
+
+    uint32_t savedTail = 0;
+    bool hasMeta = readMeta(savedTail);
+
+    if (segmentCount == 0) {
+        head = tail = hasMeta ? savedTail : 0;
+        return;
+    }
+
+    const Segment& newest = segments[segmentCount - 1];
+    uint32_t oldest = segments[0].firstSeq;
+    head = newest.firstSeq + newest.count;
+    tail = hasMeta ? savedTail : oldest;
+    if ((int32_t)(tail - oldest) < 0) tail = oldest;
+    if ((int32_t)(head - tail) < 0) tail = head;
+
+    // Power may have failed between the tail write and the deletes
+    removeDelivered();
+}
+
+bool RecordLog::readMeta(uint32_t& savedTail) {
+    bool found = false;
+    MetaRecord meta;
+    for (uint8_t slot = 0; slot < 2; slot++) {
+        if (!storage->readMeta(slot, (uint8_t*)&meta, sizeof(meta))) continue;
+        if (meta.magic != META_MAGIC) continue;
+        if (meta.crc != crc32(0, (const uint8_t*)&meta.tail, sizeof(meta.tail))) continue;
+
+        // Tails only move forward, so the larger valid one is the latest
+        if (!found || (int32_t)(meta.tail - savedTail) > 0) {
+            savedTail = meta.tail;
+            metaSlot = slot ^ 1; // next write goes to the other slot
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool RecordLog::writeMeta() {
+    MetaRecord meta = {META_MAGIC, tail, 0};
+    meta.crc = crc32(0, (const uint8_t*)&meta.tail, sizeof(meta.tail));
+
+    if (!storage->writeMeta(metaSlot, (const uint8_t*)&meta, sizeof(meta))) return false;
+    metaSlot ^= 1;
+    return true;
+}
+
+void RecordLog::removeSegment(int index) {
+    storage->remove(segments[index].id);
+    segmentCount--;
+    memmove(&segments[index], &segments[index + 1], (segmentCount - index) * sizeof(Segment));
+}
+
+void RecordLog::removeDelivered() {
+    while (segmentCount > 0 && (int32_t)(segments[0].firstSeq + segments[0].count - tail) <= 0) {
+        removeSegment(0);
+    }
+}
+
+bool RecordLog::append(const void* payload) {
+    Segment* segment = segmentCount > 0 ? &segments[segmentCount - 1] : nullptr;
+
+    if (!segment || segment->sealed || segment->count >= segmentRecords) {
+        if (segmentCount == (int)maxSegments) {
+            // Full: the oldest segment goes, delivered or not
+            const Segment& oldest = segments[0];
+            uint32_t end = oldest.firstSeq + oldest.count;
+            if ((int32_t)(end - tail) > 0) {
+                uint32_t from = (int32_t)(oldest.firstSeq - tail) > 0 ? oldest.firstSeq : tail;
+                dropCount += end - from;
+                tail = end;
+            }
+            removeSegment(0);
+        }
+        segment = &segments[segmentCount++];
+        *segment = {nextSegmentId++, head, 0, false};
+    }
+
+    RecordHeader header = {magic, head, recordCrc(head, (const uint8_t*)payload, payloadSize)};
+    if (!storage->append(segment->id, (const uint8_t*)&header, sizeof(header),
+                         (const uint8_t*)payload, payloadSize)) {
+        // Part of the record may be on flash; never append behind it
+        segment->sealed = true;
+        if (segment->count == 0) removeSegment(segmentCount - 1);
+        return false;
+    }
+
+    segment->count++;
+    head++;
+    return true;
+}
+
+bool RecordLog::read(uint32_t index, void* payload) {
+    if (index >= depth()) return false;
+
+    uint32_t seq = tail + index;
+    for (int i = 0; i < segmentCount; i++) {
+        const Segment& segment = segments[i];
+        uint32_t offset = seq - segment.firstSeq;
+        if ((int32_t)offset < 0 || offset >= segment.count) continue;
+
+        RecordHeader header;
+        return readRecord(segment, offset, header, (uint8_t*)payload);
+    }
+    return false;
+}
+
+void RecordLog::pop(uint32_t count) {
+    if (count == 0) return;
+
+    if (count > depth()) count = depth();
+    tail += count;
+    writeMeta();
+    removeDelivered();
+}
+
+void RecordLog::discard() {
+    if (depth() == 0) return;
+    pop(1);
+    dropCount++;
+}
+
+uint32_t RecordLog::depth() {
+    return head - tail;
+}
+
+uint32_t RecordLog::getDropCount() {
+    return dropCount;
+}
+
+int RecordLog::getSegmentCount() {
+    return segmentCount;
+}
@@ -0,0 +1,107 @@
+#ifndef RECORD_LOG_H
+#define RECORD_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+// Files behind a RecordLog: numbered, append-only segments plus two small
+// meta slots. TelemetryStore puts them on LittleFS; the host tests use an
+// in-memory version that can cut power in the middle of a write.
+class SegmentStorage {
+public:
+    virtual ~SegmentStorage() {}
+
+    // Existing segment ids, in any order; returns how many were written
+    virtual int list(uint32_t ids[], int capacity) = 0;
+    virtual size_t size(uint32_t id) = 0;
+    virtual bool read(uint32_t id, size_t offset, uint8_t* head, size_t headLength,
+                      uint8_t* body, size_t bodyLength) = 0;
+    // Creates the segment if needed; the data is durable once this returns true
+    virtual bool append(uint32_t id, const uint8_t* head, size_t headLength,
+                        const uint8_t* body, size_t bodyLength) = 0;
+    virtual bool remove(uint32_t id) = 0;
+
+    virtual bool readMeta(uint8_t slot, uint8_t* buffer, size_t length) = 0;
+    virtual bool writeMeta(uint8_t slot, const uint8_t* data, size_t length) = 0;
+};
+
+// Persistent FIFO of fixed-size records for store-and-forward.
+// Records are only ever appended, so each one costs a single small write and
+// nothing already on flash is rewritten. Segments hold up to segmentRecords
+// records; a segment is deleted once all of its records were delivered, or
+// dropped whole (oldest first) when the log is full.
+// Every record carries its sequence number and a CRC. At mount the head is
+// rebuilt from the segments, ignoring a record torn by power loss (its
+// segment is sealed and appending continues in a new one). The tail lives in
+// two alternating CRC-protected meta slots, so a torn meta write falls back
+// to the previous tail: records may be replayed twice, never lost.
+class RecordLog {
+public:
+    static const int MAX_SEGMENTS = STORE_CAPACITY / STORE_SEGMENT_RECORDS + 2;
+
+private:
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t crc;       // over seq and payload
+    };
+
+    struct MetaRecord {
+        uint32_t magic;
+        uint32_t tail;
+        uint32_t crc;
+    };
+
+    struct Segment {
+        uint32_t id;
+        uint32_t firstSeq;
+        uint32_t count;
+        bool sealed;        // no more appends (full, torn or from an earlier boot)
+    };
+
+    SegmentStorage* storage;
+    size_t payloadSize;
+    uint32_t magic;
+    uint32_t maxSegments;
+    uint32_t segmentRecords;
+    uint8_t* scratch;       // one payload, for checking records at mount
+
+    Segment segments[MAX_SEGMENTS];  // oldest first
+    int segmentCount;
+    uint32_t nextSegmentId;
+    uint32_t head;          // next sequence number to write
+    uint32_t tail;          // oldest sequence number not yet delivered
+    uint8_t metaSlot;
+    uint32_t dropCount;
+
+    static uint32_t recordCrc(uint32_t seq, const uint8_t* payload, size_t length);
+    bool readRecord(const Segment& segment, uint32_t index, RecordHeader& header, uint8_t* payload);
+    bool recoverSegment(uint32_t id, Segment& segment);
+    bool readMeta(uint32_t& savedTail);
+    bool writeMeta();
+    void removeSegment(int index);
+    void removeDelivered();
+
+public:
+    // capacity is rounded down to whole segments
+    RecordLog(SegmentStorage* storage, size_t payloadSize, uint32_t magic,
+              uint32_t capacity = STORE_CAPACITY, uint32_t segmentRecords = STORE_SEGMENT_RECORDS);
+    ~RecordLog();
+
+    // Rebuilds head and tail from storage
+    void begin();
+
+    bool append(const void* payload);
+
+    // index 0 is the oldest undelivered record; false if it is missing or corrupt
+    bool read(uint32_t index, void* payload);
+    void pop(uint32_t count);   // delivered; one meta write
+    void discard();             // skips the oldest record, counted as a drop
+
+    uint32_t depth();
+    uint32_t getDropCount();
+    int getSegmentCount();
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "telemetry_store.h"
+
+// Record magic changes with the summary layout, so old records are discarded
+static const uint32_t RECORD_MAGIC = 0x47540000 ^ sizeof(TelemetrySummary);
+
+// Preallocated ring file of the first store version; its in-place slot
+// writes made LittleFS copy the rest of the file on every record
+static const char* LEGACY_RECORD_FILE = "/telemetry.dat";
+static const char* LEGACY_META_FILE = "/telemetry.meta";
+
+TelemetryStore::TelemetryStore() : segments("/telemetry"), log(&segments, sizeof(StoredSummary), RECORD_MAGIC),
+                                   ready(false), bootId(0), replayCount(0) {}
+
+bool TelemetryStore::begin() {
+    if (!LittleFS.begin(true)) {
+        Serial.println("❌ LittleFS mount failed, store-and-forward disabled");
+        return false;
+    }
+
+    if (LittleFS.exists(LEGACY_RECORD_FILE)) {
+        LittleFS.remove(LEGACY_RECORD_FILE);
+        LittleFS.remove(LEGACY_META_FILE);
+    }
+
+    if (!segments.begin()) {
+        Serial.println("❌ Failed to create telemetry store");
+        return false;
+    }
+
+    bootId = esp_random();
+    log.begin();
+    ready = true;
+    Serial.printf("Telemetry store: %u record(s) pending in %d segment(s)\n", log.depth(), log.getSegmentCount());
+    return true;
+}
+
+bool TelemetryStore::push(const TelemetrySummary& summary) {
+    if (!ready) return false;
+
+    static StoredSummary record; // uplink task only
+    record.bootId = bootId;
+    record.summary = summary;
+    return log.append(&record);
+}
+
+// A record that no longer reads back is skipped, so it cannot stall the drain
+bool TelemetryStore::peek(uint32_t index, TelemetrySummary& summary, bool& fromThisBoot) {
+    if (!ready) return false;
+
+    static StoredSummary record;
+    while (!log.read(index, &record)) {
+        if (index > 0 || log.depth() == 0) return false;
+        Serial.println("⚠️ Unreadable telemetry record skipped");
+        log.discard();
+    }
+
+    summary = record.summary;
+    fromThisBoot = record.bootId == bootId;
+    return true;
+}
+
+// Called after records were delivered; one meta write per batch
+void TelemetryStore::pop(uint32_t count) {
+    if (!ready || count == 0) return;
+
+    if (count > log.depth()) count = log.depth();
+    log.pop(count);
+    replayCount += count;
+}
+
+bool TelemetryStore::isEmpty() {
+    return depth() == 0;
+}
+
+uint32_t TelemetryStore::depth() {
+    return ready ? log.depth() : 0;
+}
+
+uint32_t TelemetryStore::getDropCount() {
+    return log.getDropCount();
+}
+
+uint32_t TelemetryStore::getReplayCount() {
+    return replayCount;
+}
@@ -0,0 +1,45 @@
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "config.h"
+#include "record_log.h"
+#include "littlefs_segments.h"
+#include "../telemetry/stats_aggregator.h"
+
+// Persistent FIFO of telemetry summaries for store-and-forward: a RecordLog
+// in append-only segment files on LittleFS (see record_log.h for the
+// power-loss guarantees). Records are stamped with the boot they were
+// written in, as their timestamps are meaningless after a reboot.
+class TelemetryStore {
+private:
+    struct StoredSummary {
+        uint32_t bootId;
+        TelemetrySummary summary;
+    };
+
+    LittleFsSegments segments;
+    RecordLog log;
+    bool ready;
+    uint32_t bootId;
+    uint32_t replayCount;
+
+public:
+    TelemetryStore();
+    bool begin();
+
+    bool push(const TelemetrySummary& summary);
+
+    // Oldest undelivered record. fromThisBoot is false when its timestamps
+    // belong to a previous boot and are meaningless now.
+    bool peek(uint32_t index, TelemetrySummary& summary, bool& fromThisBoot);
+    void pop(uint32_t count);
+
+    bool isEmpty();
+    uint32_t depth();
+    uint32_t getDropCount();
+    uint32_t getReplayCount();
+};
+
+#endif
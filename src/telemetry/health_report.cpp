@@ -0,0 +1,31 @@
+#include "health_report.h"
+#include <ArduinoJson.h>
+
+size_t encodeHardwareStatus(const char* deviceNumber, const HardwareStatus& status,
+                            uint8_t* buffer, size_t capacity) {
+    StaticJsonDocument<512> doc;
+    doc["device_number"] = deviceNumber;
+
+    JsonArray valveArray = doc.createNestedArray("valves");
+    for (int i = 0; i < MAX_VALVES; i++) valveArray.add(status.valve_ok[i]);
+
+    JsonArray flowArray = doc.createNestedArray("flow_sensors");
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) flowArray.add(status.flow_ok[i]);
+
+    doc["temperature_sensor"] = status.temp_ok;
+
+    JsonArray probeArray = doc.createNestedArray("temperature_probes");
+    for (int i = 0; i < status.temp_probe_count; i++) {
+        char id[17];
+        const uint8_t* a = status.temp_probe_addr[i];
+        snprintf(id, sizeof(id), "%02X%02X%02X%02X%02X%02X%02X%02X",
+                 a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+
+        JsonObject probe = probeArray.createNestedObject();
+        probe["id"] = id;
+        probe["ok"] = status.temp_probe_ok[i];
+    }
+
+    if (measureJson(doc) >= capacity) return 0;
+    return serializeJson(doc, (char*)buffer, capacity);
+}
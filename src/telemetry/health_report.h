@@ -0,0 +1,12 @@
+#ifndef HEALTH_REPORT_H
+#define HEALTH_REPORT_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "../../include/hardware_status.h"
+
+// Health report JSON; returns the length, or 0 if it did not fit
+size_t encodeHardwareStatus(const char* deviceNumber, const HardwareStatus& status,
+                            uint8_t* buffer, size_t capacity);
+
+#endif
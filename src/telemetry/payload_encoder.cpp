@@ -0,0 +1,337 @@
+#include "payload_encoder.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static const JsonPayloadEncoder jsonEncoder;
+static const CborPayloadEncoder cborEncoder;
+
+const PayloadEncoder& payloadEncoderFor(const char* contentType) {
+    if (strcmp(contentType, "application/cbor") == 0) return cborEncoder;
+    return jsonEncoder;
+}
+
+enum class StatField { MEAN, MIN, MAX, STDDEV };
+
+static float statValue(const RunningStats& stats, StatField field) {
+    switch (field) {
+        case StatField::MEAN:   return (float)stats.mean;
+        case StatField::MIN:    return stats.minValue;
+        case StatField::MAX:    return stats.maxValue;
+        case StatField::STDDEV: return stats.stddev();
+    }
+    return 0;
+}
+
+// Age lets the backend place replayed summaries in time; -1 when unknown
+static int64_t summaryAgeMs(const TelemetrySummary& summary, int64_t nowUs) {
+    if (summary.timestampUs < 0) return -1;
+    return (nowUs - summary.timestampUs) / 1000;
+}
+
+// ---- JSON ----
+
+// Appends formatted text; once something does not fit, the writer stays failed
+class JsonWriter {
+private:
+    char* out;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+    bool firstMember;
+
+public:
+    JsonWriter(uint8_t* buffer, size_t capacity)
+        : out((char*)buffer), capacity(capacity), length(0), overflow(false), firstMember(true) {}
+
+    void print(const char* format, ...) {
+        if (overflow) return;
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(out + length, capacity - length, format, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= capacity - length) {
+            overflow = true;
+            return;
+        }
+        length += n;
+    }
+
+    void beginObject() {
+        print("{");
+        firstMember = true;
+    }
+
+    void endObject() {
+        print("}");
+        firstMember = false;
+    }
+
+    // Member name, preceded by a comma unless it opens the object
+    void key(const char* name) {
+        print(firstMember ? "\"%s\":" : ",\"%s\":", name);
+        firstMember = false;
+    }
+
+    // One statistic per channel; channels without samples are null
+    void statsArray(const char* name, const RunningStats stats[], int count, StatField field) {
+        key(name);
+        print("[");
+        for (int i = 0; i < count; i++) {
+            if (i > 0) print(",");
+            if (stats[i].count == 0) {
+                print("null");
+            } else {
+                print(field == StatField::STDDEV ? "%.3f" : "%.2f", statValue(stats[i], field));
+            }
+        }
+        print("]");
+    }
+
+    // Samples behind each channel's statistics
+    void countArray(const char* name, const RunningStats stats[], int count) {
+        key(name);
+        print("[");
+        for (int i = 0; i < count; i++) print(i > 0 ? ",%u" : "%u", stats[i].count);
+        print("]");
+    }
+
+    size_t finish() const { return overflow ? 0 : length; }
+};
+
+// Field order and precision match the original String-built payload
+static void writeJsonFields(JsonWriter& w, const TelemetrySummary& summary, bool replayed, int64_t nowUs) {
+    // flow_rates / temperature keep their old meaning (period means)
+    w.statsArray("flow_rates", summary.flow, MAX_FLOW_SENSORS, StatField::MEAN);
+    w.statsArray("flow_min", summary.flow, MAX_FLOW_SENSORS, StatField::MIN);
+    w.statsArray("flow_max", summary.flow, MAX_FLOW_SENSORS, StatField::MAX);
+    w.statsArray("flow_stddev", summary.flow, MAX_FLOW_SENSORS, StatField::STDDEV);
+
+    w.key("totals_l");
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        w.print(i > 0 ? ",%.3f" : "[%.3f", summary.totalLiters[i]);
+    }
+    w.print("]");
+    w.key("window_ms");
+    w.print("%u", summary.periodUs / 1000);
+    w.key("samples");
+    w.print("%u", summary.flow[0].count);
+    w.key("suppressed");
+    w.print("%u", summary.suppressed);
+    if (summary.leakMask) {
+        w.key("leak_mask");
+        w.print("%u", summary.leakMask);
+    }
+
+    int64_t age = summaryAgeMs(summary, nowUs);
+    w.key("age_ms");
+    if (age >= 0) {
+        w.print("%lu", (unsigned long)age);
+    } else {
+        w.print("null");
+    }
+    if (replayed) {
+        w.key("replayed");
+        w.print("true");
+    }
+
+    w.key("temperature");
+    if (summary.tempCount > 0 && summary.temperature[0].count > 0) {
+        w.print("%.2f", (float)summary.temperature[0].mean);
+    } else {
+        w.print("null");
+    }
+    w.statsArray("temperatures", summary.temperature, summary.tempCount, StatField::MEAN);
+    w.statsArray("temp_min", summary.temperature, summary.tempCount, StatField::MIN);
+    w.statsArray("temp_max", summary.temperature, summary.tempCount, StatField::MAX);
+    w.statsArray("temp_stddev", summary.temperature, summary.tempCount, StatField::STDDEV);
+    w.countArray("temp_count", summary.temperature, summary.tempCount);
+}
+
+const char* JsonPayloadEncoder::contentType() const {
+    return "application/json";
+}
+
+size_t JsonPayloadEncoder::encode(const char* deviceNumber, const TelemetrySummary summaries[], int count,
+                                  bool replayed, int64_t nowUs, uint8_t* buffer, size_t capacity) const {
+    JsonWriter w(buffer, capacity);
+    w.beginObject();
+    w.key("device_number");
+    w.print("\"%s\"", deviceNumber);
+
+    if (count == 1) {
+        writeJsonFields(w, summaries[0], replayed, nowUs);
+    } else {
+        w.key("batch");
+        w.print("[");
+        for (int i = 0; i < count; i++) {
+            if (i > 0) w.print(",");
+            w.beginObject();
+            writeJsonFields(w, summaries[i], replayed, nowUs);
+            w.endObject();
+        }
+        w.print("]");
+    }
+    w.endObject();
+    return w.finish();
+}
+
+// ---- CBOR ----
+
+class CborWriter {
+private:
+    uint8_t* out;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+
+    void put(uint8_t byte) {
+        if (length < capacity) {
+            out[length++] = byte;
+        } else {
+            overflow = true;
+        }
+    }
+
+    // Major type plus argument in the shortest form
+    void head(uint8_t major, uint32_t value) {
+        major <<= 5;
+        if (value < 24) {
+            put(major | value);
+        } else if (value <= 0xFF) {
+            put(major | 24);
+            put(value);
+        } else if (value <= 0xFFFF) {
+            put(major | 25);
+            put(value >> 8);
+            put(value);
+        } else {
+            put(major | 26);
+            for (int shift = 24; shift >= 0; shift -= 8) put(value >> shift);
+        }
+    }
+
+public:
+    CborWriter(uint8_t* buffer, size_t capacity)
+        : out(buffer), capacity(capacity), length(0), overflow(false) {}
+
+    void beginArray(uint32_t size) { head(4, size); }
+    void beginMap() { put(0xBF); }   // indefinite length, closed by endMap()
+    void endMap() { put(0xFF); }
+    void nullValue() { put(0xF6); }
+    void boolValue(bool value) { put(value ? 0xF5 : 0xF4); }
+    void unsignedValue(uint32_t value) { head(0, value); }
+
+    void text(const char* value) {
+        size_t n = strlen(value);
+        head(3, n);
+        for (size_t i = 0; i < n; i++) put(value[i]);
+    }
+
+    void floatValue(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        put(0xFA);
+        for (int shift = 24; shift >= 0; shift -= 8) put(bits >> shift);
+    }
+
+    void doubleValue(double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        put(0xFB);
+        for (int shift = 56; shift >= 0; shift -= 8) put(bits >> shift);
+    }
+
+    void statsArray(const char* name, const RunningStats stats[], int count, StatField field) {
+        text(name);
+        beginArray(count);
+        for (int i = 0; i < count; i++) {
+            if (stats[i].count == 0) {
+                nullValue();
+            } else {
+                floatValue(statValue(stats[i], field));
+            }
+        }
+    }
+
+    void countArray(const char* name, const RunningStats stats[], int count) {
+        text(name);
+        beginArray(count);
+        for (int i = 0; i < count; i++) unsignedValue(stats[i].count);
+    }
+
+    size_t finish() const { return overflow ? 0 : length; }
+};
+
+static void writeCborFields(CborWriter& w, const TelemetrySummary& summary, bool replayed, int64_t nowUs) {
+    w.statsArray("flow_rates", summary.flow, MAX_FLOW_SENSORS, StatField::MEAN);
+    w.statsArray("flow_min", summary.flow, MAX_FLOW_SENSORS, StatField::MIN);
+    w.statsArray("flow_max", summary.flow, MAX_FLOW_SENSORS, StatField::MAX);
+    w.statsArray("flow_stddev", summary.flow, MAX_FLOW_SENSORS, StatField::STDDEV);
+
+    w.text("totals_l");
+    w.beginArray(MAX_FLOW_SENSORS);
+    // Totals keep growing; float32 would lose whole litres past ~16,000 m³
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) w.doubleValue(summary.totalLiters[i]);
+
+    w.text("window_ms");
+    w.unsignedValue(summary.periodUs / 1000);
+    w.text("samples");
+    w.unsignedValue(summary.flow[0].count);
+    w.text("suppressed");
+    w.unsignedValue(summary.suppressed);
+    if (summary.leakMask) {
+        w.text("leak_mask");
+        w.unsignedValue(summary.leakMask);
+    }
+
+    int64_t age = summaryAgeMs(summary, nowUs);
+    w.text("age_ms");
+    if (age >= 0) {
+        w.unsignedValue(age > UINT32_MAX ? UINT32_MAX : (uint32_t)age);
+    } else {
+        w.nullValue();
+    }
+    if (replayed) {
+        w.text("replayed");
+        w.boolValue(true);
+    }
+
+    w.text("temperature");
+    if (summary.tempCount > 0 && summary.temperature[0].count > 0) {
+        w.floatValue((float)summary.temperature[0].mean);
+    } else {
+        w.nullValue();
+    }
+    w.statsArray("temperatures", summary.temperature, summary.tempCount, StatField::MEAN);
+    w.statsArray("temp_min", summary.temperature, summary.tempCount, StatField::MIN);
+    w.statsArray("temp_max", summary.temperature, summary.tempCount, StatField::MAX);
+    w.statsArray("temp_stddev", summary.temperature, summary.tempCount, StatField::STDDEV);
+    w.countArray("temp_count", summary.temperature, summary.tempCount);
+}
+
+const char* CborPayloadEncoder::contentType() const {
+    return "application/cbor";
+}
+
+size_t CborPayloadEncoder::encode(const char* deviceNumber, const TelemetrySummary summaries[], int count,
+                                  bool replayed, int64_t nowUs, uint8_t* buffer, size_t capacity) const {
+    CborWriter w(buffer, capacity);
+    w.beginMap();
+    w.text("device_number");
+    w.text(deviceNumber);
+
+    if (count == 1) {
+        writeCborFields(w, summaries[0], replayed, nowUs);
+    } else {
+        w.text("batch");
+        w.beginArray(count);
+        for (int i = 0; i < count; i++) {
+            w.beginMap();
+            writeCborFields(w, summaries[i], replayed, nowUs);
+            w.endMap();
+        }
+    }
+    w.endMap();
+    return w.finish();
+}
@@ -0,0 +1,44 @@
+#ifndef PAYLOAD_ENCODER_H
+#define PAYLOAD_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "telemetry_summary.h"
+
+// Serializes telemetry summaries for /api/device/data straight into a
+// caller-owned buffer, without touching the heap. Both formats carry the same
+// keys: one summary is sent as a flat object (the original shape), several as
+// {"device_number", "batch": [...]}, oldest first. Builds on the host, so
+// test/test_payload_encoder can measure it.
+class PayloadEncoder {
+public:
+    virtual ~PayloadEncoder() {}
+    virtual const char* contentType() const = 0;
+
+    // Returns the encoded length, or 0 if the payload did not fit.
+    // nowUs is the esp_timer time of sending; summary ages are taken from it.
+    virtual size_t encode(const char* deviceNumber, const TelemetrySummary summaries[], int count,
+                          bool replayed, int64_t nowUs, uint8_t* buffer, size_t capacity) const = 0;
+};
+
+class JsonPayloadEncoder : public PayloadEncoder {
+public:
+    const char* contentType() const override;
+    size_t encode(const char* deviceNumber, const TelemetrySummary summaries[], int count,
+                  bool replayed, int64_t nowUs, uint8_t* buffer, size_t capacity) const override;
+};
+
+// RFC 8949 CBOR: definite-length arrays, indefinite-length maps,
+// float32 statistics, float64 totals and null for channels without samples
+class CborPayloadEncoder : public PayloadEncoder {
+public:
+    const char* contentType() const override;
+    size_t encode(const char* deviceNumber, const TelemetrySummary summaries[], int count,
+                  bool replayed, int64_t nowUs, uint8_t* buffer, size_t capacity) const override;
+};
+
+// Encoder for a content type; anything unknown gets JSON
+const PayloadEncoder& payloadEncoderFor(const char* contentType);
+
+#endif
@@ -0,0 +1,82 @@
+#include "report_filter.h"
+
+ReportFilter::ReportFilter() : hasReported(false), lastReport(0), sentCount(0),
+                               suppressedCount(0), suppressedSinceReport(0) {
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        flowBands[i] = {FLOW_DEADBAND_ABS, FLOW_DEADBAND_REL};
+        lastFlow[i] = 0;
+    }
+    for (int i = 0; i < MAX_TEMP_PROBES; i++) {
+        tempBands[i] = {TEMP_DEADBAND_ABS, TEMP_DEADBAND_REL};
+        lastTemp[i] = 0;
+        lastTempValid[i] = false;
+    }
+}
+
+void ReportFilter::setFlowDeadband(int channel, float absolute, float relative) {
+    flowBands[channel] = {absolute, relative};
+}
+
+void ReportFilter::setTemperatureDeadband(int probe, float absolute, float relative) {
+    tempBands[probe] = {absolute, relative};
+}
+
+// Extremes get twice the band so sample noise alone does not defeat suppression,
+// while a real transient inside an otherwise flat period still gets reported
+bool ReportFilter::outside(const RunningStats& stats, float last, const Deadband& band) {
+    float limit = max(band.absolute, band.relative * fabsf(last));
+    return fabsf((float)stats.mean - last) > limit ||
+           fabsf(stats.minValue - last) > 2 * limit ||
+           fabsf(stats.maxValue - last) > 2 * limit;
+}
+
+bool ReportFilter::shouldReport(TelemetrySummary& summary) {
+    bool report = !hasReported || millis() - lastReport >= REPORT_MAX_SILENCE;
+
+    for (int i = 0; i < MAX_FLOW_SENSORS && !report; i++) {
+        if (summary.flow[i].count > 0 && outside(summary.flow[i], lastFlow[i], flowBands[i])) {
+            report = true;
+        }
+    }
+
+    // Appearing/disappearing follows probe health; a period without a
+    // conversion of a healthy probe is simply not compared
+    for (int i = 0; i < MAX_TEMP_PROBES && !report; i++) {
+        bool valid = i < summary.tempCount && (summary.tempOkMask & (1 << i));
+        if (valid != lastTempValid[i]) {
+            report = true;
+        } else if (valid && summary.temperature[i].count > 0 &&
+                   outside(summary.temperature[i], lastTemp[i], tempBands[i])) {
+            report = true;
+        }
+    }
+
+    if (!report) {
+        suppressedCount++;
+        suppressedSinceReport++;
+        return false;
+    }
+
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        if (summary.flow[i].count > 0) lastFlow[i] = summary.flow[i].mean;
+    }
+    for (int i = 0; i < MAX_TEMP_PROBES; i++) {
+        lastTempValid[i] = i < summary.tempCount && (summary.tempOkMask & (1 << i));
+        if (lastTempValid[i] && summary.temperature[i].count > 0) lastTemp[i] = summary.temperature[i].mean;
+    }
+
+    summary.suppressed = suppressedSinceReport;
+    suppressedSinceReport = 0;
+    hasReported = true;
+    lastReport = millis();
+    sentCount++;
+    return true;
+}
+
+uint32_t ReportFilter::getSentCount() {
+    return sentCount;
+}
+
+uint32_t ReportFilter::getSuppressedCount() {
+    return suppressedCount;
+}
@@ -0,0 +1,45 @@
+#ifndef REPORT_FILTER_H
+#define REPORT_FILTER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "stats_aggregator.h"
+
+struct Deadband {
+    float absolute;
+    float relative;
+};
+
+// Report-by-exception for telemetry summaries.
+// A summary passes when any channel's mean (or, with twice the margin, its
+// min/max) leaves the deadband around the last reported mean, when a probe
+// turns healthy or faulty, or when nothing has been reported for REPORT_MAX_SILENCE.
+class ReportFilter {
+private:
+    Deadband flowBands[MAX_FLOW_SENSORS];
+    Deadband tempBands[MAX_TEMP_PROBES];
+    float lastFlow[MAX_FLOW_SENSORS];
+    float lastTemp[MAX_TEMP_PROBES];
+    bool lastTempValid[MAX_TEMP_PROBES];
+    bool hasReported;
+    unsigned long lastReport;
+
+    uint32_t sentCount;
+    uint32_t suppressedCount;
+    uint32_t suppressedSinceReport;
+
+    static bool outside(const RunningStats& stats, float last, const Deadband& band);
+
+public:
+    ReportFilter();
+    void setFlowDeadband(int channel, float absolute, float relative);
+    void setTemperatureDeadband(int probe, float absolute, float relative);
+
+    // Decides and records the outcome; fills summary.suppressed when it passes
+    bool shouldReport(TelemetrySummary& summary);
+
+    uint32_t getSentCount();
+    uint32_t getSuppressedCount();
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "stats_aggregator.h"
+
+StatsAggregator::StatsAggregator() {
+    reset();
+}
+
+void StatsAggregator::reset() {
+    current.timestampUs = 0;
+    current.periodUs = 0;
+    current.tempCount = 0;
+    current.tempOkMask = 0;
+    current.suppressed = 0;
+    current.leakMask = 0;
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        current.flow[i].reset();
+        current.totalLiters[i] = 0;
+    }
+    for (int i = 0; i < MAX_TEMP_PROBES; i++) {
+        current.temperature[i].reset();
+    }
+}
+
+void StatsAggregator::addFlow(const FlowSample& sample) {
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        current.flow[i].add(sample.rates[i], sample.windowUs);
+        current.totalLiters[i] = sample.totalLiters[i];
+    }
+    current.periodUs += sample.windowUs;
+    current.timestampUs = sample.timestampUs;
+}
+
+void StatsAggregator::addTemperatures(const TemperatureSample& sample) {
+    current.tempCount = sample.count;
+    current.tempOkMask = 0;
+    for (int i = 0; i < sample.count; i++) {
+        if (sample.ok[i]) {
+            current.temperature[i].add(sample.values[i]);
+            current.tempOkMask |= 1 << i;
+        }
+    }
+}
+
+bool StatsAggregator::hasData() {
+    return current.flow[0].count > 0;
+}
+
+void StatsAggregator::takeSummary(TelemetrySummary& summary) {
+    summary = current;
+    int tempCount = current.tempCount;
+    uint8_t tempOkMask = current.tempOkMask;
+    reset();
+
+    // Probe health outlives the period: not every period has a conversion
+    current.tempCount = tempCount;
+    current.tempOkMask = tempOkMask;
+}
@@ -0,0 +1,26 @@
+#ifndef STATS_AGGREGATOR_H
+#define STATS_AGGREGATOR_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "../hardware/sensor_manager.h"
+#include "telemetry_summary.h"
+
+// Sits between SensorManager and the uploaders: absorbs every internal sample
+// and hands out one summary per reporting period.
+class StatsAggregator {
+private:
+    TelemetrySummary current;
+
+public:
+    StatsAggregator();
+    void reset();
+    void addFlow(const FlowSample& sample);
+    void addTemperatures(const TemperatureSample& sample);
+    bool hasData();
+
+    // Copies the running summary out and starts a new period
+    void takeSummary(TelemetrySummary& summary);
+};
+
+#endif
@@ -0,0 +1,32 @@
+#include "telemetry_summary.h"
+#include <math.h>
+
+void RunningStats::reset() {
+    count = 0;
+    minValue = 0;
+    maxValue = 0;
+    weight = 0;
+    mean = 0;
+    m2 = 0;
+}
+
+void RunningStats::add(float value, double w) {
+    if (w <= 0) return;
+
+    if (count == 0 || value < minValue) minValue = value;
+    if (count == 0 || value > maxValue) maxValue = value;
+    count++;
+
+    weight += w;
+    double delta = value - mean;
+    mean += delta * w / weight;
+    m2 += w * delta * (value - mean);
+}
+
+float RunningStats::variance() const {
+    return weight > 0 ? m2 / weight : 0;
+}
+
+float RunningStats::stddev() const {
+    return sqrtf(variance());
+}
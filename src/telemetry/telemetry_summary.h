@@ -0,0 +1,35 @@
+#ifndef TELEMETRY_SUMMARY_H
+#define TELEMETRY_SUMMARY_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Streaming weighted min/max/mean/variance (West's variant of Welford), O(1) memory
+struct RunningStats {
+    uint32_t count;
+    float minValue;
+    float maxValue;
+    double weight;
+    double mean;
+    double m2;
+
+    void reset();
+    void add(float value, double w = 1.0);
+    float variance() const;
+    float stddev() const;
+};
+
+// Everything emitted for one reporting period
+struct TelemetrySummary {
+    int64_t timestampUs;                        // end of the period; -1 if unknown (previous boot)
+    uint32_t periodUs;                          // sum of the flow sample windows
+    RunningStats flow[MAX_FLOW_SENSORS];        // L/min, weighted by window length
+    double totalLiters[MAX_FLOW_SENSORS];       // cumulative volume at end of period
+    int tempCount;
+    RunningStats temperature[MAX_TEMP_PROBES];  // °C, one entry per conversion
+    uint32_t suppressed;                        // periods withheld since the last upload
+    uint8_t leakMask;                           // channels in leak state; flushes batches
+    uint8_t tempOkMask;                         // bit i: probe i read back valid at its last conversion
+};
+
+#endif
@@ -0,0 +1,115 @@
+// Host tests for the lock-free pulse counter protocol (hardware/pulse_channel.h)
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "hardware/pulse_channel.h"
+
+static PulseChannel channel;
+
+void setUp() {
+    memset((void*)&channel, 0, sizeof(channel));
+}
+
+void tearDown() {}
+
+void test_delta_counts_every_pulse() {
+    uint32_t snapshot = 0;
+    for (uint32_t i = 0; i < 5; i++) channel.record(i);
+    TEST_ASSERT_EQUAL_UINT32(5, channel.takeDelta(snapshot));
+    TEST_ASSERT_EQUAL_UINT32(0, channel.takeDelta(snapshot));
+
+    channel.record(5);
+    TEST_ASSERT_EQUAL_UINT32(1, channel.takeDelta(snapshot));
+}
+
+void test_delta_survives_counter_wrap() {
+    channel.count = 0xFFFFFFF0u;
+    uint32_t snapshot = channel.count;
+    for (uint32_t i = 0; i < 32; i++) channel.record(i);
+
+    TEST_ASSERT_EQUAL_UINT32(16, channel.count);
+    TEST_ASSERT_EQUAL_UINT32(32, channel.takeDelta(snapshot));
+}
+
+void test_readers_keep_independent_snapshots() {
+    uint32_t sampler = 0;
+    uint32_t other = 0;
+    for (uint32_t i = 0; i < 10; i++) channel.record(i);
+
+    TEST_ASSERT_EQUAL_UINT32(10, channel.takeDelta(sampler));
+    channel.record(10);
+    TEST_ASSERT_EQUAL_UINT32(11, channel.takeDelta(other));
+    TEST_ASSERT_EQUAL_UINT32(1, channel.takeDelta(sampler));
+}
+
+void test_recent_times_oldest_first() {
+    uint32_t times[FLOW_PULSE_HISTORY];
+    TEST_ASSERT_EQUAL_INT(0, channel.recentTimes(times));
+
+    for (uint32_t i = 0; i < 3; i++) channel.record(100 + i);
+    TEST_ASSERT_EQUAL_INT(3, channel.recentTimes(times));
+    TEST_ASSERT_EQUAL_UINT32(100, times[0]);
+    TEST_ASSERT_EQUAL_UINT32(102, times[2]);
+
+    for (uint32_t i = 3; i < 21; i++) channel.record(100 + i);
+    TEST_ASSERT_EQUAL_INT(FLOW_PULSE_HISTORY, channel.recentTimes(times));
+    for (int k = 0; k < FLOW_PULSE_HISTORY; k++) {
+        TEST_ASSERT_EQUAL_UINT32(121 - FLOW_PULSE_HISTORY + k, times[k]);
+    }
+}
+
+// A pulse train far faster than any flow sensor (the writer never sleeps)
+// against a reader that keeps sampling: the deltas must add up exactly.
+void test_concurrent_pulse_train_loses_nothing() {
+    const uint32_t pulses = 5000000;
+    std::atomic<bool> done(false);
+
+    std::thread isr([&]() {
+        for (uint32_t i = 0; i < pulses; i++) channel.record(i);
+        done = true;
+    });
+
+    uint32_t snapshot = 0;
+    uint64_t seen = 0;
+    uint32_t reads = 0;
+    while (!done) {
+        seen += channel.takeDelta(snapshot);
+        reads++;
+    }
+    isr.join();
+    seen += channel.takeDelta(snapshot);
+
+    TEST_ASSERT_GREATER_THAN(1, reads);
+    TEST_ASSERT_EQUAL_UINT32(pulses, (uint32_t)seen);
+}
+
+// Same, with the counter crossing 2^32 while the reader is sampling
+void test_concurrent_pulse_train_across_wrap() {
+    const uint32_t pulses = 1000000;
+    channel.count = 0xFFFFFFFFu - pulses / 2;
+    uint32_t snapshot = channel.count;
+    std::atomic<bool> done(false);
+
+    std::thread isr([&]() {
+        for (uint32_t i = 0; i < pulses; i++) channel.record(i);
+        done = true;
+    });
+
+    uint64_t seen = 0;
+    while (!done) seen += channel.takeDelta(snapshot);
+    isr.join();
+    seen += channel.takeDelta(snapshot);
+
+    TEST_ASSERT_EQUAL_UINT32(pulses, (uint32_t)seen);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_delta_counts_every_pulse);
+    RUN_TEST(test_delta_survives_counter_wrap);
+    RUN_TEST(test_readers_keep_independent_snapshots);
+    RUN_TEST(test_recent_times_oldest_first);
+    RUN_TEST(test_concurrent_pulse_train_loses_nothing);
+    RUN_TEST(test_concurrent_pulse_train_across_wrap);
+    return UNITY_END();
+}
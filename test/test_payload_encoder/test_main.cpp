@@ -0,0 +1,380 @@
+// Host tests and a size/throughput benchmark for the telemetry payload
+// encoders (telemetry/payload_encoder.h)
+#include <unity.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include "telemetry/payload_encoder.h"
+
+static const int64_t NOW_US = 3600000000LL;
+static TelemetrySummary summaries[UPLINK_BATCH_SIZE];
+static uint8_t buffer[UPLINK_PAYLOAD_BUFFER];
+
+// A typical period: flow on two channels, four probes with two conversions each
+static void fillSummary(TelemetrySummary& summary, int n) {
+    memset(&summary, 0, sizeof(summary));
+    summary.timestampUs = NOW_US - (UPLINK_BATCH_SIZE - n) * 30000000LL;
+    summary.periodUs = 30000000;
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        summary.flow[i].reset();
+        for (int k = 0; k < 30; k++) summary.flow[i].add(i < 2 ? 11.5f + k * 0.1f : 0, 1000000);
+        summary.totalLiters[i] = 123456.789 + i;
+    }
+    summary.tempCount = MAX_TEMP_PROBES;
+    for (int i = 0; i < MAX_TEMP_PROBES; i++) {
+        summary.temperature[i].reset();
+        summary.temperature[i].add(21.25f + i);
+        summary.temperature[i].add(21.75f + i);
+        summary.tempOkMask |= 1 << i;
+    }
+}
+
+static size_t find(const uint8_t* data, size_t length, const char* text) {
+    size_t n = strlen(text);
+    for (size_t i = 0; i + n <= length; i++) {
+        if (memcmp(data + i, text, n) == 0) return i;
+    }
+    return length;
+}
+
+// Every operator new in this process is counted, to check that the encoders
+// stay off the heap
+static size_t heapAllocations;
+
+void* operator new(size_t size) {
+    heapAllocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// ---- Reference: the String-built payload the encoders replaced ----
+// Host copy of HTTPClientManager's statsArray / appendSummaryFields /
+// sendSensorBatch from before the encoders. Arduino String becomes
+// std::string (both grow on the heap), String(float, n) its "%.nf" and
+// String(integer) std::to_string.
+// temp_stddev and temp_count came later; they are appended the same way so
+// the comparison is like for like.
+
+static std::string arduinoString(double value, int decimals = 2) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f", decimals, value);
+    return text;
+}
+
+enum class LegacyField { MEAN, MIN, MAX, STDDEV };
+
+static std::string legacyStatsArray(const RunningStats stats[], int count, LegacyField field) {
+    std::string out = "[";
+    for (int i = 0; i < count; i++) {
+        if (stats[i].count == 0) {
+            out += "null";
+        } else {
+            switch (field) {
+                case LegacyField::MEAN:   out += arduinoString((float)stats[i].mean); break;
+                case LegacyField::MIN:    out += arduinoString(stats[i].minValue); break;
+                case LegacyField::MAX:    out += arduinoString(stats[i].maxValue); break;
+                case LegacyField::STDDEV: out += arduinoString(stats[i].stddev(), 3); break;
+            }
+        }
+        if (i < count - 1) out += ",";
+    }
+    return out + "]";
+}
+
+static void legacySummaryFields(std::string& json, const TelemetrySummary& summary, bool replayed) {
+    json += "\"flow_rates\":" + legacyStatsArray(summary.flow, MAX_FLOW_SENSORS, LegacyField::MEAN);
+    json += ",\"flow_min\":" + legacyStatsArray(summary.flow, MAX_FLOW_SENSORS, LegacyField::MIN);
+    json += ",\"flow_max\":" + legacyStatsArray(summary.flow, MAX_FLOW_SENSORS, LegacyField::MAX);
+    json += ",\"flow_stddev\":" + legacyStatsArray(summary.flow, MAX_FLOW_SENSORS, LegacyField::STDDEV);
+
+    json += ",\"totals_l\":[";
+    for (int i = 0; i < MAX_FLOW_SENSORS; i++) {
+        json += arduinoString(summary.totalLiters[i], 3);
+        if (i < MAX_FLOW_SENSORS - 1) json += ",";
+    }
+    json += "],\"window_ms\":" + std::to_string(summary.periodUs / 1000);
+    json += ",\"samples\":" + std::to_string(summary.flow[0].count);
+    json += ",\"suppressed\":" + std::to_string(summary.suppressed);
+    if (summary.leakMask) json += ",\"leak_mask\":" + std::to_string(summary.leakMask);
+
+    int64_t age = summary.timestampUs >= 0 ? (NOW_US - summary.timestampUs) / 1000 : -1;
+    json += ",\"age_ms\":" + (age >= 0 ? std::to_string((unsigned long)age) : std::string("null"));
+    if (replayed) json += ",\"replayed\":true";
+
+    bool hasTemp = summary.tempCount > 0 && summary.temperature[0].count > 0;
+    json += ",\"temperature\":" + (hasTemp ? arduinoString((float)summary.temperature[0].mean) : std::string("null"));
+    json += ",\"temperatures\":" + legacyStatsArray(summary.temperature, summary.tempCount, LegacyField::MEAN);
+    json += ",\"temp_min\":" + legacyStatsArray(summary.temperature, summary.tempCount, LegacyField::MIN);
+    json += ",\"temp_max\":" + legacyStatsArray(summary.temperature, summary.tempCount, LegacyField::MAX);
+    json += ",\"temp_stddev\":" + legacyStatsArray(summary.temperature, summary.tempCount, LegacyField::STDDEV);
+    json += ",\"temp_count\":[";
+    for (int i = 0; i < summary.tempCount; i++) {
+        json += std::to_string(summary.temperature[i].count);
+        if (i < summary.tempCount - 1) json += ",";
+    }
+    json += "]";
+}
+
+static std::string legacyEncode(const std::string& deviceNumber, const TelemetrySummary summaries[], int count,
+                                bool replayed) {
+    std::string json;
+    if (count == 1) {
+        json = "{\"device_number\":\"" + deviceNumber + "\",";
+        legacySummaryFields(json, summaries[0], replayed);
+        return json + "}";
+    }
+
+    json.reserve(count * 512);
+    json = "{\"device_number\":\"" + deviceNumber + "\",\"batch\":[";
+    for (int i = 0; i < count; i++) {
+        json += "{";
+        legacySummaryFields(json, summaries[i], replayed);
+        json += (i < count - 1) ? "}," : "}";
+    }
+    return json + "]}";
+}
+
+void setUp() {
+    for (int i = 0; i < UPLINK_BATCH_SIZE; i++) fillSummary(summaries[i], i);
+}
+
+void tearDown() {}
+
+void test_cbor_totals_are_float64() {
+    const PayloadEncoder& cbor = payloadEncoderFor("application/cbor");
+    summaries[0].totalLiters[0] = 16777217.125; // not representable as float32
+    size_t length = cbor.encode("GM-1", summaries, 1, false, NOW_US, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+
+    size_t at = find(buffer, length, "totals_l");
+    TEST_ASSERT_LESS_THAN(length, at);
+    const uint8_t* p = buffer + at + 8;
+    TEST_ASSERT_EQUAL_HEX8(0x80 | MAX_FLOW_SENSORS, p[0]);
+    TEST_ASSERT_EQUAL_HEX8(0xFB, p[1]);
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; i++) bits = bits << 8 | p[2 + i];
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    TEST_ASSERT_TRUE(value == 16777217.125);
+}
+
+void test_json_single_and_batch_shapes() {
+    const PayloadEncoder& json = payloadEncoderFor("application/json");
+    size_t length = json.encode("GM-1", summaries, 1, false, NOW_US, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+    buffer[length] = 0;
+    TEST_ASSERT_EQUAL_INT(0, strncmp((char*)buffer, "{\"device_number\":\"GM-1\",\"flow_rates\":[", 38));
+    TEST_ASSERT_TRUE(strstr((char*)buffer, "\"age_ms\":150000") != NULL);
+
+    length = json.encode("GM-1", summaries, UPLINK_BATCH_SIZE, true, NOW_US, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+    buffer[length] = 0;
+    TEST_ASSERT_TRUE(strstr((char*)buffer, "\"batch\":[{") != NULL);
+    TEST_ASSERT_TRUE(strstr((char*)buffer, "\"replayed\":true") != NULL);
+}
+
+void test_temperature_spread_and_counts() {
+    summaries[0].temperature[3].reset(); // probe 3 had no good conversion
+    size_t length = payloadEncoderFor("application/json")
+                        .encode("GM-1", summaries, 1, false, NOW_US, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+    buffer[length] = 0;
+    TEST_ASSERT_TRUE(strstr((char*)buffer, "\"temperatures\":[21.50,22.50,23.50,null]") != NULL);
+    TEST_ASSERT_TRUE(strstr((char*)buffer, "\"temp_stddev\":[0.250,0.250,0.250,null]") != NULL);
+    TEST_ASSERT_TRUE(strstr((char*)buffer, "\"temp_count\":[2,2,2,0]") != NULL);
+
+    length = payloadEncoderFor("application/cbor")
+                 .encode("GM-1", summaries, 1, false, NOW_US, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+
+    // 0.25f is 0x3E800000
+    size_t at = find(buffer, length, "temp_stddev");
+    TEST_ASSERT_LESS_THAN(length, at);
+    const uint8_t stddev[] = {0x84, 0xFA, 0x3E, 0x80, 0x00, 0x00};
+    TEST_ASSERT_EQUAL_MEMORY(stddev, buffer + at + 11, sizeof(stddev));
+    TEST_ASSERT_EQUAL_HEX8(0xF6, buffer[at + 11 + 1 + 3 * 5]);
+
+    at = find(buffer, length, "temp_count");
+    TEST_ASSERT_LESS_THAN(length, at);
+    const uint8_t counts[] = {0x84, 0x02, 0x02, 0x02, 0x00};
+    TEST_ASSERT_EQUAL_MEMORY(counts, buffer + at + 10, sizeof(counts));
+}
+
+void test_unknown_age_is_null() {
+    summaries[0].timestampUs = -1;
+    size_t length = payloadEncoderFor("application/json")
+                        .encode("GM-1", summaries, 1, false, NOW_US, buffer, sizeof(buffer));
+    buffer[length] = 0;
+    TEST_ASSERT_TRUE(strstr((char*)buffer, "\"age_ms\":null") != NULL);
+}
+
+void test_overflow_returns_zero() {
+    const char* types[] = {"application/json", "application/cbor"};
+    for (const char* type : types) {
+        const PayloadEncoder& encoder = payloadEncoderFor(type);
+        size_t full = encoder.encode("GM-1", summaries, UPLINK_BATCH_SIZE, false, NOW_US, buffer, sizeof(buffer));
+        TEST_ASSERT_GREATER_THAN(0, full);
+        TEST_ASSERT_EQUAL_size_t(0, encoder.encode("GM-1", summaries, UPLINK_BATCH_SIZE, false, NOW_US,
+                                                   buffer, full - 1));
+    }
+}
+
+// The JSON encoder replaced the String-built payload without changing a byte
+void test_json_matches_string_built_payload() {
+    summaries[1].leakMask = 0x2;
+    summaries[2].timestampUs = -1;
+    summaries[3].temperature[2].reset();
+
+    const PayloadEncoder& json = payloadEncoderFor("application/json");
+    const int counts[] = {1, UPLINK_BATCH_SIZE};
+    for (int count : counts) {
+        for (int replayed = 0; replayed < 2; replayed++) {
+            std::string expected = legacyEncode("GM-1", summaries, count, replayed);
+            size_t length = json.encode("GM-1", summaries, count, replayed, NOW_US, buffer, sizeof(buffer));
+            TEST_ASSERT_EQUAL_size_t(expected.size(), length);
+            buffer[length] = 0;
+            TEST_ASSERT_EQUAL_STRING(expected.c_str(), (char*)buffer);
+        }
+    }
+}
+
+void test_encoders_do_not_allocate() {
+    const char* types[] = {"application/json", "application/cbor"};
+    const PayloadEncoder* encoders[] = {&payloadEncoderFor(types[0]), &payloadEncoderFor(types[1])};
+
+    heapAllocations = 0;
+    for (const PayloadEncoder* encoder : encoders) {
+        TEST_ASSERT_GREATER_THAN(0, encoder->encode("GM-1", summaries, 1, false, NOW_US, buffer, sizeof(buffer)));
+        TEST_ASSERT_GREATER_THAN(0, encoder->encode("GM-1", summaries, UPLINK_BATCH_SIZE, true, NOW_US,
+                                                    buffer, sizeof(buffer)));
+        encoder->encode("GM-1", summaries, UPLINK_BATCH_SIZE, false, NOW_US, buffer, 100); // overflow path
+    }
+    TEST_ASSERT_EQUAL_size_t(0, heapAllocations);
+
+    // The counter does see allocations: the String-built payload makes plenty
+    legacyEncode("GM-1", summaries, 1, false);
+    TEST_ASSERT_GREATER_THAN(10, heapAllocations);
+}
+
+// Payload size and host encode time against the String-built payload, per
+// format and batch size. Host times only rank the encoders; the on-device
+// cost is in the heartbeat's encode counter.
+void test_benchmark_size_and_throughput() {
+    const char* names[] = {"String (before)", "application/json", "application/cbor"};
+    const int counts[] = {1, UPLINK_BATCH_SIZE};
+    const int rounds = 20000;
+    size_t sizes[3][2];
+    double micros[3][2];
+
+    for (int t = 0; t < 3; t++) {
+        for (int c = 0; c < 2; c++) {
+            size_t length = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < rounds; r++) {
+                if (t == 0) {
+                    length = legacyEncode("GM-1", summaries, counts[c], false).size();
+                } else {
+                    length = payloadEncoderFor(names[t]).encode("GM-1", summaries, counts[c], false, NOW_US,
+                                                                buffer, sizeof(buffer));
+                }
+            }
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            TEST_ASSERT_GREATER_THAN(0, length);
+            sizes[t][c] = length;
+            micros[t][c] = us / rounds;
+
+            char line[160];
+            snprintf(line, sizeof(line), "%-16s x%d: %4u bytes (%3u%%), %6.2f us/encode (%5.2fx)",
+                     names[t], counts[c], (unsigned)length, (unsigned)(length * 100 / sizes[0][c]),
+                     micros[t][c], micros[0][c] / micros[t][c]);
+            TEST_MESSAGE(line);
+        }
+    }
+
+    for (int c = 0; c < 2; c++) {
+        TEST_ASSERT_EQUAL_size_t(sizes[0][c], sizes[1][c]);
+        TEST_ASSERT_LESS_THAN(sizes[1][c], sizes[2][c]);
+    }
+}
+
+// Bytes on the wire per HTTP upload over a kept-alive connection to
+// BACKEND_BASE_URL: the request line and headers HTTPClient sends, a small
+// JSON reply, and per-frame TCP/IPv4 (40) plus 802.11 data framing (36) for
+// the request segments, the reply and one pure ACK each way.
+struct WireCost {
+    size_t bytes;
+    int frames;
+};
+
+static WireCost uploadCost(const char* contentType, size_t payloadLength) {
+    char request[256];
+    int headerLength = snprintf(request, sizeof(request),
+                                "POST %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: ESP32HTTPClient\r\n"
+                                "Connection: keep-alive\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n"
+                                "Content-Type: %s\r\nContent-Length: %u\r\n\r\n",
+                                SENSOR_DATA_PATH, BACKEND_BASE_URL + 7, contentType, (unsigned)payloadLength);
+    const char* reply = "HTTP/1.1 200 OK\r\ndate: Thu, 15 Oct 2026 12:00:00 GMT\r\nserver: uvicorn\r\n"
+                        "content-length: 16\r\ncontent-type: application/json\r\n\r\n{\"status\":\"ok\"}";
+    const size_t mss = 1460;
+    const size_t frameOverhead = 40 + 36;
+
+    size_t requestLength = headerLength + payloadLength;
+    int requestFrames = (requestLength + mss - 1) / mss;
+    int frames = requestFrames + 1 + 2;
+    return {requestLength + strlen(reply) + frames * frameOverhead, frames};
+}
+
+// Batched vs one summary per request. Radio-on time is not modelled here:
+// it depends on DTIM, power-save mode and the AP, and is measured on the
+// device from the uplink latency in the heartbeat.
+void test_batched_bytes_on_wire() {
+    const char* types[] = {"application/json", "application/cbor"};
+    for (const char* type : types) {
+        const PayloadEncoder& encoder = payloadEncoderFor(type);
+        size_t single = encoder.encode("GM-1", summaries, 1, false, NOW_US, buffer, sizeof(buffer));
+        size_t batch = encoder.encode("GM-1", summaries, UPLINK_BATCH_SIZE, false, NOW_US, buffer, sizeof(buffer));
+        TEST_ASSERT_GREATER_THAN(0, single);
+        TEST_ASSERT_GREATER_THAN(0, batch);
+
+        WireCost singleCost = uploadCost(type, single);
+        WireCost batchCost = uploadCost(type, batch);
+        size_t singleTotal = singleCost.bytes * UPLINK_BATCH_SIZE;
+        int singleFrames = singleCost.frames * UPLINK_BATCH_SIZE;
+
+        char line[160];
+        snprintf(line, sizeof(line),
+                 "%-16s %d summaries: single %5u bytes / %2d frames, batched %5u bytes / %2d frames (-%u%%)",
+                 type, UPLINK_BATCH_SIZE, (unsigned)singleTotal, singleFrames, (unsigned)batchCost.bytes,
+                 batchCost.frames, (unsigned)(100 - batchCost.bytes * 100 / singleTotal));
+        TEST_MESSAGE(line);
+
+        TEST_ASSERT_LESS_THAN(singleTotal, batchCost.bytes);
+        TEST_ASSERT_LESS_THAN(singleFrames, batchCost.frames);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_cbor_totals_are_float64);
+    RUN_TEST(test_json_single_and_batch_shapes);
+    RUN_TEST(test_temperature_spread_and_counts);
+    RUN_TEST(test_unknown_age_is_null);
+    RUN_TEST(test_overflow_returns_zero);
+    RUN_TEST(test_json_matches_string_built_payload);
+    RUN_TEST(test_encoders_do_not_allocate);
+    RUN_TEST(test_benchmark_size_and_throughput);
+    RUN_TEST(test_batched_bytes_on_wire);
+    return UNITY_END();
+}
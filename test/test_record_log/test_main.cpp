@@ -0,0 +1,305 @@
+// Host tests for the store-and-forward log (storage/record_log.h), including
+// power cuts in the middle of record and meta writes
+#include <unity.h>
+#include <map>
+#include <vector>
+#include <random>
+#include "storage/record_log.h"
+
+static const uint32_t MAGIC = 0x7E570001;
+
+struct Payload {
+    uint32_t value;
+    uint8_t filler[60];
+};
+
+// In-memory flash. Once the write budget runs out the write in progress is
+// cut short and every later write fails, until reboot() restores power.
+class MemorySegments : public SegmentStorage {
+public:
+    std::map<uint32_t, std::vector<uint8_t>> files;
+    std::vector<uint8_t> meta;
+    long budget = -1;   // bytes that can still be written; -1 = unlimited
+
+    void reboot() { budget = -1; }
+
+    size_t allow(size_t length) {
+        if (budget < 0) return length;
+        size_t n = (size_t)budget < length ? (size_t)budget : length;
+        budget -= n;
+        return n;
+    }
+
+    int list(uint32_t ids[], int capacity) override {
+        int n = 0;
+        for (auto& file : files) {
+            if (n < capacity) ids[n++] = file.first;
+        }
+        return n;
+    }
+
+    size_t size(uint32_t id) override {
+        auto it = files.find(id);
+        return it == files.end() ? 0 : it->second.size();
+    }
+
+    bool read(uint32_t id, size_t offset, uint8_t* head, size_t headLength,
+              uint8_t* body, size_t bodyLength) override {
+        auto it = files.find(id);
+        if (it == files.end() || offset + headLength + bodyLength > it->second.size()) return false;
+        memcpy(head, &it->second[offset], headLength);
+        memcpy(body, &it->second[offset + headLength], bodyLength);
+        return true;
+    }
+
+    bool append(uint32_t id, const uint8_t* head, size_t headLength,
+                const uint8_t* body, size_t bodyLength) override {
+        if (budget == 0) return false;
+        std::vector<uint8_t>& file = files[id];
+        size_t n = allow(headLength);
+        file.insert(file.end(), head, head + n);
+        if (n < headLength) return false;
+        n = allow(bodyLength);
+        file.insert(file.end(), body, body + n);
+        return n == bodyLength;
+    }
+
+    bool remove(uint32_t id) override {
+        if (budget == 0) return false;
+        return files.erase(id) > 0;
+    }
+
+    bool readMeta(uint8_t slot, uint8_t* buffer, size_t length) override {
+        if (meta.size() < (slot + 1) * length) return false;
+        memcpy(buffer, &meta[slot * length], length);
+        return true;
+    }
+
+    bool writeMeta(uint8_t slot, const uint8_t* data, size_t length) override {
+        if (budget == 0) return false;
+        if (meta.size() < (slot + 1) * length) meta.resize((slot + 1) * length);
+        size_t n = allow(length);
+        memcpy(&meta[slot * length], data, n);
+        return n == length;
+    }
+};
+
+static MemorySegments* flash;
+
+static bool push(RecordLog& log, uint32_t value) {
+    Payload p;
+    p.value = value;
+    memset(p.filler, (uint8_t)value, sizeof(p.filler));
+    return log.append(&p);
+}
+
+static std::vector<uint32_t> contents(RecordLog& log) {
+    std::vector<uint32_t> values;
+    Payload p;
+    for (uint32_t i = 0; i < log.depth(); i++) {
+        if (!log.read(i, &p)) break;
+        values.push_back(p.value);
+    }
+    return values;
+}
+
+void setUp() {
+    flash = new MemorySegments();
+}
+
+void tearDown() {
+    delete flash;
+}
+
+void test_records_survive_reboot_in_order() {
+    {
+        RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+        log.begin();
+        for (uint32_t i = 0; i < 20; i++) TEST_ASSERT_TRUE(push(log, i));
+        TEST_ASSERT_EQUAL_UINT32(20, log.depth());
+        TEST_ASSERT_EQUAL_INT(3, log.getSegmentCount());
+    }
+
+    RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+    log.begin();
+    std::vector<uint32_t> values = contents(log);
+    TEST_ASSERT_EQUAL_UINT32(20, values.size());
+    for (uint32_t i = 0; i < 20; i++) TEST_ASSERT_EQUAL_UINT32(i, values[i]);
+}
+
+void test_appends_never_rewrite_written_bytes() {
+    RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+    log.begin();
+    push(log, 0);
+    std::vector<uint8_t> first = flash->files.begin()->second;
+
+    for (uint32_t i = 1; i < 8; i++) push(log, i);
+    TEST_ASSERT_EQUAL_MEMORY(first.data(), flash->files.begin()->second.data(), first.size());
+}
+
+void test_pop_deletes_delivered_segments_and_persists_tail() {
+    {
+        RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+        log.begin();
+        for (uint32_t i = 0; i < 20; i++) push(log, i);
+        log.pop(5);
+        TEST_ASSERT_EQUAL_UINT32(3, flash->files.size());
+        log.pop(5);
+        TEST_ASSERT_EQUAL_UINT32(2, flash->files.size());
+    }
+
+    RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+    log.begin();
+    std::vector<uint32_t> values = contents(log);
+    TEST_ASSERT_EQUAL_UINT32(10, values.size());
+    TEST_ASSERT_EQUAL_UINT32(10, values[0]);
+}
+
+void test_full_log_drops_oldest_segment() {
+    RecordLog log(flash, sizeof(Payload), MAGIC, 32, 8);
+    log.begin();
+    for (uint32_t i = 0; i < 40; i++) TEST_ASSERT_TRUE(push(log, i));
+
+    TEST_ASSERT_EQUAL_INT(4, log.getSegmentCount());
+    TEST_ASSERT_EQUAL_UINT32(4, flash->files.size());
+    TEST_ASSERT_EQUAL_UINT32(8, log.getDropCount());
+    std::vector<uint32_t> values = contents(log);
+    TEST_ASSERT_EQUAL_UINT32(32, values.size());
+    TEST_ASSERT_EQUAL_UINT32(8, values[0]);
+    TEST_ASSERT_EQUAL_UINT32(39, values.back());
+}
+
+void test_torn_record_is_ignored_and_appending_continues() {
+    {
+        RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+        log.begin();
+        for (uint32_t i = 0; i < 5; i++) push(log, i);
+        flash->budget = 30; // power fails inside the header/payload of record 5
+        TEST_ASSERT_FALSE(push(log, 5));
+    }
+    flash->reboot();
+
+    RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+    log.begin();
+    TEST_ASSERT_EQUAL_UINT32(5, log.depth());
+
+    // The torn segment is sealed; new records go to a fresh one
+    for (uint32_t i = 5; i < 10; i++) TEST_ASSERT_TRUE(push(log, i));
+    TEST_ASSERT_EQUAL_INT(2, log.getSegmentCount());
+    std::vector<uint32_t> values = contents(log);
+    TEST_ASSERT_EQUAL_UINT32(10, values.size());
+    for (uint32_t i = 0; i < 10; i++) TEST_ASSERT_EQUAL_UINT32(i, values[i]);
+}
+
+void test_corrupt_last_record_is_ignored() {
+    {
+        RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+        log.begin();
+        for (uint32_t i = 0; i < 3; i++) push(log, i);
+    }
+    std::vector<uint8_t>& file = flash->files.begin()->second;
+    file[file.size() - 1] ^= 0xFF;
+
+    RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+    log.begin();
+    TEST_ASSERT_EQUAL_UINT32(2, log.depth());
+}
+
+void test_torn_meta_write_falls_back_to_previous_tail() {
+    {
+        RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+        log.begin();
+        for (uint32_t i = 0; i < 6; i++) push(log, i);
+        log.pop(2);
+        flash->budget = 5;
+        log.pop(2);
+    }
+    flash->reboot();
+
+    // Records 2 and 3 are replayed, nothing is lost
+    RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+    log.begin();
+    std::vector<uint32_t> values = contents(log);
+    TEST_ASSERT_EQUAL_UINT32(4, values.size());
+    TEST_ASSERT_EQUAL_UINT32(2, values[0]);
+}
+
+void test_meta_slots_alternate() {
+    {
+        RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+        log.begin();
+        for (uint32_t i = 0; i < 6; i++) push(log, i);
+        log.pop(1);
+        log.pop(1);
+        log.pop(1);
+    }
+
+    RecordLog log(flash, sizeof(Payload), MAGIC, 64, 8);
+    log.begin();
+    TEST_ASSERT_EQUAL_UINT32(3, log.depth());
+    log.pop(1);
+
+    RecordLog again(flash, sizeof(Payload), MAGIC, 64, 8);
+    again.begin();
+    TEST_ASSERT_EQUAL_UINT32(2, again.depth());
+}
+
+// Random pushes and pops with the power cut at a random byte, many times over.
+// After every reboot the log must hold a gap-free run of records that ends
+// with the last acknowledged push and starts no later than the first record
+// not yet popped or dropped for space: replays are allowed, losses are not.
+void test_random_power_cuts_never_lose_records() {
+    std::mt19937 rng(1234);
+    uint32_t nextValue = 0;
+    uint32_t delivered = 0;   // everything below this was popped or dropped
+    uint32_t acked = 0;       // everything below this was appended successfully
+
+    for (int round = 0; round < 300; round++) {
+        RecordLog log(flash, sizeof(Payload), MAGIC, 4096, 8);
+        log.begin();
+
+        std::vector<uint32_t> values = contents(log);
+        TEST_ASSERT_EQUAL_UINT32(log.depth(), values.size());
+        for (size_t i = 1; i < values.size(); i++) TEST_ASSERT_EQUAL_UINT32(values[i - 1] + 1, values[i]);
+        if (acked > delivered) {
+            TEST_ASSERT_TRUE(!values.empty());
+            TEST_ASSERT_LESS_OR_EQUAL(delivered, values.front());
+            TEST_ASSERT_EQUAL_UINT32(acked - 1, values.back());
+        }
+        if (!values.empty()) {
+            delivered = values.front();
+            nextValue = values.back() + 1;
+        } else {
+            nextValue = acked;
+        }
+
+        flash->budget = rng() % 2000;
+        for (int op = 0; op < 40; op++) {
+            if (rng() % 3 == 0) {
+                uint32_t count = rng() % 4;
+                if (count > log.depth()) count = log.depth();
+                log.pop(count);
+                delivered += count;
+            } else if (push(log, nextValue)) {
+                acked = ++nextValue;
+            }
+        }
+        delivered += log.getDropCount();
+        flash->reboot();
+    }
+    TEST_ASSERT_GREATER_THAN(100, acked);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_records_survive_reboot_in_order);
+    RUN_TEST(test_appends_never_rewrite_written_bytes);
+    RUN_TEST(test_pop_deletes_delivered_segments_and_persists_tail);
+    RUN_TEST(test_full_log_drops_oldest_segment);
+    RUN_TEST(test_torn_record_is_ignored_and_appending_continues);
+    RUN_TEST(test_corrupt_last_record_is_ignored);
+    RUN_TEST(test_torn_meta_write_falls_back_to_previous_tail);
+    RUN_TEST(test_meta_slots_alternate);
+    RUN_TEST(test_random_power_cuts_never_lose_records);
+    return UNITY_END();
+}